@@ -19,10 +19,14 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <limits.h>
 #include <Eina.h>
+#include <Ecore.h>
 
 #include "ede.h"
 #include "ede_gui.h"
+#include "ede_astar.h"
 #include "ede_utils.h"
 
 #define LOCAL_DEBUG 0
@@ -57,380 +61,3822 @@ char *state_names[ST_COUNT] = {
    "ST_MAXLOOPS"
 };
 
+/* as shown in the debug panel */
+static const char *query_names[PATHFINDER_QUERY_COUNT] = {
+   "path",
+   "check",
+   "job",
+   "field",
+   "reachable",
+   "placement"
+};
+
+/* as used in the level files */
+static const char *mode_names[PATHFINDER_MODE_COUNT] = {
+   "astar",
+   "flowfield",
+   "jps",
+   "hpa",
+   "bidir"
+};
+
+/* node states */
+enum {
+   NODE_NEW,   // never reached in the current search
+   NODE_OPEN,  // in the open heap, waiting to be expanded
+   NODE_CLOSED // expanded yet
+};
+
+/* Search node, one for each cell of the grid. A node is only meaningful if
+ * its generation is the same of the search, otherwise it's left over from a
+ * previous search and must be considered NODE_NEW. In this way starting a new
+ * search just need to increment the generation, without clearing the table */
+typedef struct _Node Node;
+struct _Node
+{
+   int g;               // cost of the best path found so far from the start
+   int h;               // estimated cost from here to the target
+   int parent;          // packed position of the parent cell
+   int heap_index;      // position inside the open heap (only if NODE_OPEN)
+   unsigned int gen;    // generation of the search that last touched the node
+   unsigned char state; // NODE_NEW, NODE_OPEN or NODE_CLOSED
+};
+
+/* All the scratch memory needed by a search, allocated once for the grid
+ * size and reused by every search on the same grid */
+typedef struct _Search Search;
+struct _Search
+{
+   int rows, cols;   // size of the grid the table is allocated for
+   Node *nodes;      // nodes table, indexed by packed cell
+   int *heap;        // open list, binary heap of packed cells (lowest F on top)
+   int heap_count;   // number of cells in the open list (with any queue)
+   unsigned int gen; // current search generation
+
+   // open list as a bucket queue (only used by PATHFINDER_QUEUE_BUCKETS)
+   Ede_Pathfinder_Queue queue; // the kind of open list of the current search
+   int *buckets;     // first entry of every bucket (-1 if empty)
+   int buckets_mask; // number of buckets - 1 (a power of 2)
+   int bucket_cur;   // the lowest F cost that can be in the open list
+   int *entries;     // entries_size couples (packed cell, next entry)
+   int entries_count, entries_size;
+
+   // the query being run, so that a search can be suspended and resumed
+   int start, target;          // packed start and target cells
+   int target_row, target_col;
+   Eina_Bool (*is_walkable)(int row, int col);
+   Ede_Pathfinder_Mode mode;
+   int loops;                  // cells expanded so far
+   int open_peak;              // max cells in the open list at once
+   const Ede_Walkable_Map *map; // bitmap to use instead of is_walkable
+                                // (NULL if none for the current search)
+   Eina_Bool landmarks;        // use the ALT heuristic in the current search
+   Eina_Bool smooth;           // string pull the path of the current search
+};
+
+/* Distance-and-direction field toward a single goal cell (the home).
+ * Built with a reverse Dijkstra from the goal, it tell for every cell the
+ * cost to reach the goal and the direction of the next hop, so all the
+ * enemies going to the same goal can share it instead of searching alone */
+typedef struct _Field Field;
+struct _Field
+{
+   int rows, cols;     // size of the grid the field is allocated for
+   int goal;           // packed goal cell
+   int *dist;          // cost to reach the goal (FIELD_INF if none)
+   int *rhs;           // one step lookahead of dist, used by the repair
+   unsigned char *dir; // direction of the next hop (DIR_NONE if none)
+   Eina_Bool (*is_walkable)(int row, int col); // as given at build time
+   Eina_Bool valid;    // EINA_FALSE until the first build
+};
+#define FIELD_INF (INT_MAX / 2)
+
+/* Landmarks for the ALT heuristic: a few cells with the exact cost from every
+ * other cell to them. For any landmark L the triangle inequality give
+ * |cost(n,L) - cost(target,L)| <= cost(n,target), a lower bound that, unlike
+ * the octile distance, know about the walls. */
+#define LANDMARKS_MAX 16
+
+typedef struct _Landmarks Landmarks;
+struct _Landmarks
+{
+   int count;                   // landmarks in use (0 if the heuristic is off)
+   Field fields[LANDMARKS_MAX]; // the cost tables, one field for landmark
+};
+
+/* Hierarchical abstraction of the grid (HPA*). The grid is split in square
+ * clusters, the walkable openings on the borders between two clusters are
+ * the entrances. For each cluster the cost between every couple of its
+ * entrance cells is cached, so a search can run on the (small) graph of the
+ * entrance cells instead of on the whole grid. */
+#define HPA_CLUSTER_SIZE 10 // cells on a cluster side
+#define HPA_MAX_NODES 20    // max entrance cells in a cluster (5 per border)
+#define HPA_INF FIELD_INF
+
+typedef struct _Hpa_Cluster Hpa_Cluster;
+struct _Hpa_Cluster
+{
+   int row, col, rows, cols;  // the cells covered by the cluster
+   int count;                 // number of entrance cells
+   int cells[HPA_MAX_NODES];  // packed entrance cells
+   int *costs;                // count * count costs between the entrances
+};
+
+typedef struct _Hpa Hpa;
+struct _Hpa
+{
+   int rows, cols;             // size of the grid
+   int crows, ccols;           // number of clusters
+   Hpa_Cluster *clusters;      // crows * ccols clusters
+   Eina_Bool (*is_walkable)(int row, int col); // as given at build time
+   Eina_Bool valid;            // EINA_FALSE until the first build
+};
+
+/* For every cell: would an area placed with the top-left corner there cut
+ * all the ways from a start cell to the goal? Calculated for a whole grid
+ * revision at once, so the placement preview don't need any search. */
+typedef struct _Blocking Blocking;
+struct _Blocking
+{
+   int rows, cols;           // size of the grid
+   int area_rows, area_cols; // size of the area to place
+   unsigned int revision;    // grid revision the map is valid for
+   unsigned char *map;       // rows * cols, 1 if the placement is blocking
+   // the flood tree from the goal, all rows * cols
+   int *pre;                 // preorder index of the cell in the tree
+   int *size;                // cells in the subtree of the cell
+   int *below;               // start cells in the subtree of the cell
+   unsigned int *seen;       // stamp of the last local flood that met the cell
+   unsigned char *start;     // 1 if the cell is a start cell
+   Eina_Bool valid;
+};
+
+/* Copy of the walkability of the grid at a given revision, for the searches
+ * run by the worker threads. They can't call is_walkable() as the main loop
+ * can change (or even reload) the level while they are running. */
+typedef struct _Snapshot Snapshot;
+struct _Snapshot
+{
+   int refcount;
+   unsigned int revision;
+   Eina_Bool (*is_walkable)(int row, int col); // the one it is taken from
+   Ede_Walkable_Map *map;
+};
+
+#define PATH_CACHE_SIZE 64 // max number of paths kept in the cache
+#define CACHE_SLOT(_SR_,_SC_,_GR_,_GC_,_MODE_) \
+   (((unsigned int)((_SR_) * 7919 + (_SC_) * 131 + (_GR_) * 31 + (_GC_) + (_MODE_))) % PATH_CACHE_SIZE)
+
+/* A path request to be calculated a bit at a time, in the frames to come,
+ * not to block the game while many enemies need a new path at once */
+struct _Ede_Path_Job
+{
+   int rows, cols;
+   int start_row, start_col, goal_row, goal_col;
+   Eina_Bool (*is_walkable)(int row, int col);
+   Ede_Pathfinder_Mode mode;
+   unsigned int revision;
+   Ede_Pathfinder_Queue queue; // the settings at request time, the workers
+   Eina_Bool smooth;           // must not read the global ones
+   Ede_Path_Job_Cb done_cb;
+   void *data;
+   Ecore_Thread *thread; // the worker calculating the path, if any
+   Snapshot *snapshot;   // the grid used by the worker
+   Ede_Path *path;       // the result of the worker
+   int state;            // the final state of the worker search
+   int loops, open_peak; // of the search, for the statistics
+   double added;         // when the job has been requested
+   Eina_Bool canceled;   // canceled while in the worker, free when it ends
+};
+#define PATH_JOBS_BUDGET 2000 // default time given to the jobs every frame (usec)
+#define PATH_JOBS_SLICE 256   // cells expanded between two checks of the clock
+
 /* Local subsystem vars */
-static int **Gcost; // 2 dim array containing the G cost for each cell
-static int **Hcost; // 2 dim array containing the H cost for each cell
-static int **Fcost; // 2 dim array containing the F cost for each cell
-static int **Parent;// 2 dim array containing the packed pos of the parent for each cell
-static Eina_List *OpenList; // ordered eina_list of packed cells to check (sorted by F cost for fast access to the lowest F)
-static Eina_List *CloseList; // ordered eina_list of packed cells checked yet (sorted by packed coord)
-static int LevelRows; // current level size
-static int LevelCols; // current level size
+static Search _search; // the one used by ede_pathfinder()
+static Search _search_back; // the backward one of the bidirectional search
+static Ede_Pathfinder_Stats _stats; // always collected, for the debug panel
+static Search _job_search; // the one used by the jobs run in the main loop
+static Ede_Path_Job *_job_running; // the job suspended in _job_search
+static Eina_List *_jobs;   // the pending jobs, in request order
+static int _jobs_budget;   // usec per frame
+static Ede_Pathfinder_Queue _queue; // the open list used by the A* searches
+static Eina_Bool _smooth;  // string pull the paths found by the searches
+static int _workers;       // max jobs given to the worker threads at once
+static int _jobs_threads;  // jobs given to the workers and not finished yet
+static Eina_Hash *_jobs_in_workers; // the jobs in the workers, by request
+static Snapshot *_snapshot; // the last grid snapshot taken
+static const Ede_Walkable_Map *_map; // the bitmap kept by the grid owner
+static Eina_Bool (*_map_is_walkable)(int row, int col); // ...equivalent to
+static unsigned char _map_dirs_table[512]; // 3x3 block => allowed moves
+static Field _field;   // the flow field toward home
+static Landmarks _landmarks; // the tables for the ALT heuristic
+static Hpa _hpa;       // the hierarchical graph of the level
+static Blocking _blocking; // the placement blocking map
+static int _excluded_row, _excluded_col, _excluded_rows, _excluded_cols;
+static Eina_Bool (*_excluded_is_walkable)(int row, int col);
+static Ede_Path *_cache[PATH_CACHE_SIZE]; // direct mapped by start & goal
+static Eina_List *_routes;      // the precomputed paths from the start cells
+static Eina_List *_routes_jobs; // the jobs calculating them
 
 static Eina_Bool info_to_console; //whenever to dump to console
 static Eina_Bool info_in_game; //whenever to dump results in game
 
 
-//TODO can optimize this 2?
-//TODO describe this
-#define PACK(_ROW_,_COL_) (_ROW_ * LevelCols + _COL_)
-#define UNPACK(_PACKED_) _PACKED_ / LevelCols, _PACKED_ % LevelCols
-#define UNPACK_ROW(_PACKED_) (_PACKED_ / LevelCols)
-#define UNPACK_COL(_PACKED_) (_PACKED_ % LevelCols)
+/* A cell position (row, col) is packed in a single int (row * cols + col),
+ * used to index the nodes table and to store cells in the open heap */
+#define PACK(_S_,_ROW_,_COL_) ((_ROW_) * (_S_)->cols + (_COL_))
+#define UNPACK_ROW(_S_,_PACKED_) ((_PACKED_) / (_S_)->cols)
+#define UNPACK_COL(_S_,_PACKED_) ((_PACKED_) % (_S_)->cols)
+
+/* Octile distance, the exact cost of the shortest path between two cells
+ * if there are no walls in between: 14 for each diagonal hop and 10 for each
+ * orthogonal one. It never overestimate the real cost, so A* stay optimal. */
+#define HEURISTIC(_R1_,_C1_,_R2_,_C2_) _octile(abs((_R1_) - (_R2_)), abs((_C1_) - (_C2_)))
+
+/* The 8 directions a cell can be left from, clockwise starting from up.
+ * The order match the OVERLAY_0..OVERLAY_7 arrows and the enemy angle
+ * (direction * 45). Odd directions are the diagonal ones. */
+static const int dir_row[8] = { -1, -1, 0, 1, 1,  1,  0, -1 };
+static const int dir_col[8] = {  0,  1, 1, 1, 0, -1, -1, -1 };
+#define DIR_NONE 8
+#define DIR_COST(_DIR_) ((_DIR_) & 1 ? 14 : 10)
+#define DIR_OPPOSITE(_DIR_) (((_DIR_) + 4) & 7)
+#define DIR_ROTATE(_DIR_,_STEPS_) (((_DIR_) + (_STEPS_)) & 7) // steps of 45 deg
 
 
 /* Local subsystem functions */
-static void
-_dump_list(Eina_List *list, Eina_Bool to_console, Eina_Bool in_game)
+static inline int
+_octile(int drow, int dcol)
 {
-   Eina_List *l;
-   int r, c, pr, pc;
-   int packed;
+   return drow < dcol ? 14 * drow + 10 * (dcol - drow) :
+                        14 * dcol + 10 * (drow - dcol);
+}
 
-   if (to_console)
-      printf("%sList [count: %d]\n", list == OpenList ? "Open" : "Close",
-                                     eina_list_count(list));
-
-   for (l = list; l; l = l->next)
-   {
-      packed = (long)l->data;
-
-      r = UNPACK_ROW(packed);
-      c = UNPACK_COL(packed);
-      pr = UNPACK_ROW(Parent[r][c]);
-      pc = UNPACK_COL(Parent[r][c]);
-
-      if (to_console)
-         printf("  cell: %d (%d,%d) [G:%d H:%d F:%d] [Parent:%d,%d]\n", packed,
-                r, c, Gcost[r][c], Hcost[r][c], Fcost[r][c], pr, pc);
-      if (in_game)
-      {
-         ede_gui_cell_overlay_add(list == OpenList ? OVERLAY_BORDER_GREEN : OVERLAY_BORDER_BLUE, r, c);
-         ede_gui_cell_overlay_text_set(r, c, Fcost[r][c], 1);
-         ede_gui_cell_overlay_text_set(r, c, Gcost[r][c], 2);
-         ede_gui_cell_overlay_text_set(r, c, Hcost[r][c], 3);
-         if      (pr == r - 1 && pc == c - 1) ede_gui_cell_overlay_add(OVERLAY_7, r, c);
-         else if (pr == r - 1 && pc == c ) ede_gui_cell_overlay_add(OVERLAY_0, r, c);
-         else if (pr == r - 1 && pc == c + 1) ede_gui_cell_overlay_add(OVERLAY_1, r, c);
-         else if (pr == r && pc == c - 1) ede_gui_cell_overlay_add(OVERLAY_6, r, c);
-         else if (pr == r && pc == c) {}
-         else if (pr == r && pc == c + 1) ede_gui_cell_overlay_add(OVERLAY_2, r, c);
-         else if (pr == r + 1 && pc == c - 1) ede_gui_cell_overlay_add(OVERLAY_5, r, c);
-         else if (pr == r + 1 && pc == c) ede_gui_cell_overlay_add(OVERLAY_4, r, c);
-         else if (pr == r + 1 && pc == c + 1) ede_gui_cell_overlay_add(OVERLAY_3, r, c);
-      }
+/**
+ * Make the search tables big enough for a grid of the given size.
+ * Tables are only reallocated when the grid size change.
+ */
+static Eina_Bool
+_search_grid_set(Search *s, int rows, int cols)
+{
+   if (s->nodes && s->rows == rows && s->cols == cols)
+      return EINA_TRUE;
+
+   D("REALLOC nodes table & open heap for a %dx%d grid\n", rows, cols);
+   EDE_FREE(s->nodes);
+   EDE_FREE(s->heap);
+   s->nodes = calloc(rows * cols, sizeof(Node));
+   s->heap = malloc(rows * cols * sizeof(int));
+   if (!s->nodes || !s->heap)
+   {
+      CRITICAL("Failure to allocate mem for the pathfinder");
+      EDE_FREE(s->nodes);
+      EDE_FREE(s->heap);
+      s->rows = s->cols = 0;
+      return EINA_FALSE;
    }
-   if (to_console) printf("\n");
+   s->rows = rows;
+   s->cols = cols;
+   s->gen = 0;
+   return EINA_TRUE;
 }
 
-static int
-_sort_by_Fcost(const void *packed1, const void *packed2)
+static void
+_search_free(Search *s)
 {
-   int row, col;
-   int Fa, Fb;
+   EDE_FREE(s->nodes);
+   EDE_FREE(s->heap);
+   EDE_FREE(s->buckets);
+   EDE_FREE(s->entries);
+   s->entries_size = 0;
+   s->rows = s->cols = 0;
+}
 
-   // get F cost for element 1
-   row = UNPACK_ROW((int)packed1);
-   col = UNPACK_COL((int)packed1);
-   Fa = Fcost[row][col];
+static void
+_hpa_free(Hpa *h)
+{
+   int i;
 
-   // get F cost for element 2
-   row = UNPACK_ROW((int)packed2);
-   col = UNPACK_COL((int)packed2);
-   Fb = Fcost[row][col];
+   if (h->clusters)
+      for (i = 0; i < h->crows * h->ccols; i++)
+         EDE_FREE(h->clusters[i].costs);
+   EDE_FREE(h->clusters);
+   h->crows = h->ccols = 0;
+   h->valid = EINA_FALSE;
+}
 
-   // simply compare F costs
-   return Fa - Fb;
+static void
+_blocking_free(Blocking *b)
+{
+   EDE_FREE(b->map);
+   EDE_FREE(b->pre);
+   EDE_FREE(b->size);
+   EDE_FREE(b->below);
+   EDE_FREE(b->seen);
+   EDE_FREE(b->start);
+   b->valid = EINA_FALSE;
 }
 
-static int
-_sort_by_packed(const void *packed1, const void *packed2)
+/* The jobs in the workers are hashed by request (start, goal, mode and
+ * revision): the job itself is the key */
+static unsigned int
+_job_key_length(const void *key EINA_UNUSED)
 {
-   return (int)packed1 - (int)packed2;
+   return sizeof(Ede_Path_Job);
 }
 
-/* Externally accessible functions */
-EAPI Eina_Bool
-ede_pathfinder_init(void)
+static int
+_job_key_cmp(const Ede_Path_Job *a, int a_length EINA_UNUSED,
+             const Ede_Path_Job *b, int b_length EINA_UNUSED)
 {
-   DBG(" ");
-   Gcost = Hcost = Fcost = Parent = NULL;
-   OpenList = CloseList = NULL;
-   LevelRows = LevelCols = 0;
-   info_to_console = info_in_game = EINA_FALSE;
-   return EINA_TRUE;
+   if (a->start_row != b->start_row) return a->start_row - b->start_row;
+   if (a->start_col != b->start_col) return a->start_col - b->start_col;
+   if (a->goal_row != b->goal_row) return a->goal_row - b->goal_row;
+   if (a->goal_col != b->goal_col) return a->goal_col - b->goal_col;
+   if (a->mode != b->mode) return (int)a->mode - (int)b->mode;
+   return a->revision == b->revision ? 0 : a->revision < b->revision ? -1 : 1;
 }
 
-EAPI Eina_Bool
-ede_pathfinder_shutdown(void)
+static int
+_job_key_hash(const Ede_Path_Job *job, int length EINA_UNUSED)
 {
-   DBG(" ");
-   ede_array_free(Gcost);
-   ede_array_free(Hcost);
-   ede_array_free(Fcost);
-   ede_array_free(Parent);
-   return EINA_TRUE;
+   return CACHE_SLOT(job->start_row, job->start_col,
+                     job->goal_row, job->goal_col, job->mode) * 31 +
+          (int)job->revision;
 }
 
-EAPI Eina_List *
-ede_pathfinder(int level_rows, int level_cols,
-               int start_row, int start_col,
-               int target_row, int target_col,
-               Eina_Bool (*is_walkable)(int row, int col),
-               int max_loops, Eina_Bool just_check)
+static void
+_snapshot_unref(Snapshot *snap)
 {
-   Eina_Counter *time_counter;
-   Eina_List *path = NULL; // RETURNED. List of packed cells that make the route to follow for reaching the target
-   int adiacentPacked, startPacked;
-   int curRow, curCol, curPacked; // point to the cell we are checking
-   int row, col; // used to loop the 8 adiacent cell
-   int loops, G, state;
-   Eina_List *l;
-   Eina_Bool corner_walkable;
+   if (--snap->refcount > 0)
+      return;
+   ede_pathfinder_walkable_map_free(snap->map);
+   EDE_FREE(snap);
+}
 
-   if (max_loops < 1) max_loops = level_rows * level_cols;
+/**
+ * Start a new search, invalidating all the nodes of the previous one.
+ * @param is_walkable the walkability used by the search, if the grid owner
+ *        keep a bitmap for it the bitmap is used instead. NULL to keep the
+ *        bitmap already set in the context (as the workers do).
+ */
+static void
+_search_begin(Search *s, Eina_Bool (*is_walkable)(int row, int col))
+{
+   if (is_walkable)
+      s->map = (_map && is_walkable == _map_is_walkable &&
+                _map->rows == s->rows && _map->cols == s->cols) ? _map : NULL;
 
-   D("\n----------  A *  -----------\n");
-   D("From: %d,%d To: %d,%d [map: %d,%d][max loops: %d]\n\n", start_row, start_col,
-           target_row, target_col, level_rows, level_cols, max_loops);
+   s->queue = PATHFINDER_QUEUE_HEAP;
+   s->landmarks = EINA_FALSE;
+   s->heap_count = 0;
+   s->loops = s->open_peak = 0;
+   // on generation overflow clear the whole table, or nodes untouched since
+   // 4 billion searches ago will be considered valid again
+   if (++s->gen == 0)
+   {
+      memset(s->nodes, 0, s->rows * s->cols * sizeof(Node));
+      s->gen = 1;
+   }
+}
 
-   time_counter = eina_counter_new("Ede A*");
-   eina_counter_start(time_counter);
+/**
+ * Get the node for the given packed cell, resetting it if it belong to an
+ * old search.
+ */
+static inline Node *
+_search_node(Search *s, int packed)
+{
+   Node *n = &s->nodes[packed];
 
-   // alloc/realloc all the array if needed
-   //TODO realloc on board size change
-   if (!Gcost)
+   if (n->gen != s->gen)
    {
-      D("REALLOC costs & parent arrays (G, H and F. ParentX & ParentY)\n");
-      Gcost = ede_array_new(level_rows, level_cols);
-      Hcost = ede_array_new(level_rows, level_cols);
-      Fcost = ede_array_new(level_rows, level_cols);
-      Parent = ede_array_new(level_rows, level_cols);
-      if (!Gcost || !Hcost || !Fcost || !Parent) return EINA_FALSE;
+      n->gen = s->gen;
+      n->state = NODE_NEW;
    }
+   return n;
+}
 
-   eina_counter_stop(time_counter, 0);
-   eina_counter_start(time_counter);
+/**
+ * Get the 3 walkability bits of the given (padded) row, starting at the
+ * given (padded) col. The spare word at the end of the rows make it safe to
+ * always read two words.
+ */
+static inline unsigned int
+_map_bits3(const Ede_Walkable_Map *m, int prow, int pcol)
+{
+   const unsigned int *w = m->bits + prow * m->stride + (pcol >> 5);
+   unsigned long long v = w[0] | ((unsigned long long)w[1] << 32);
 
-   // store the level dimension in a global variable to be accessibile from
-   // the list sort function
-   LevelRows = level_rows;
-   LevelCols = level_cols;
+   return (v >> (pcol & 31)) & 7;
+}
 
-   // Check to see if start and target are walkable
-   if (!is_walkable(start_row, start_col) ||
-       !is_walkable(target_row, target_col))
+/**
+ * Get all the moves allowed from a cell, as a mask of directions (bit
+ * N set if the move in direction N is allowed). Just three reads of the
+ * bitmap and a table lookup, the border of walls make any bounds check
+ * unnecessary.
+ */
+static inline unsigned int
+_map_dirs(const Ede_Walkable_Map *m, int row, int col)
+{
+   // the 3x3 block around the cell, the row above in the lower bits
+   return _map_dirs_table[_map_bits3(m, row, col) |
+                          _map_bits3(m, row + 1, col) << 3 |
+                          _map_bits3(m, row + 2, col) << 6];
+}
+
+/**
+ * Build the table of the allowed moves for every possible 3x3 block of
+ * cells, with the same rules of _move_allowed().
+ */
+static void
+_map_dirs_table_init(void)
+{
+   int block, dir, dr, dc;
+
+   for (block = 0; block < 512; block++)
    {
-      state = ST_TARGET_UNREACHABLE;
-      goto end;
+      _map_dirs_table[block] = 0;
+      for (dir = 0; dir < 8; dir++)
+      {
+         dr = dir_row[dir] + 1;
+         dc = dir_col[dir] + 1;
+         if (!(block & (1 << (dr * 3 + dc))))
+            continue;
+         // Don't cut across corners
+         if ((dir & 1) && (!(block & (1 << (dr * 3 + 1))) ||
+                           !(block & (1 << (3 + dc)))))
+            continue;
+         _map_dirs_table[block] |= 1 << dir;
+      }
    }
+}
+
+/**
+ * Check if a cell (inside the grid) is walkable, in the bitmap of the grid
+ * if the search has one.
+ */
+static inline Eina_Bool
+_search_walkable(Search *s, Eina_Bool (*is_walkable)(int row, int col),
+                 int row, int col)
+{
+   if (s->map)
+      return EDE_WALKABLE_MAP_GET(s->map, row, col);
+   return is_walkable(row, col);
+}
 
-   // TODO check if start and target are the same cell
+/**
+ * Check if an enemy can move from the given cell to the adiacent one in the
+ * given direction: the destination must be inside the grid and walkable, and
+ * diagonal moves can't cut across corners (both the orthogonal cells must be
+ * walkable too).
+ * NOTE: the check is symmetric, if A can go to B then B can go to A
+ */
+static inline Eina_Bool
+_move_allowed(Search *s, Eina_Bool (*is_walkable)(int row, int col),
+              int row, int col, int dir)
+{
+   int nrow = row + dir_row[dir];
+   int ncol = col + dir_col[dir];
 
+   if (s->map)
+      return (_map_dirs(s->map, row, col) >> dir) & 1;
 
-   // add the starting location to the open list of cells to be checked
-   // and set its G cost to 0
-   startPacked = PACK(start_row, start_col);
-   OpenList = eina_list_append(OpenList, (void*)startPacked);
-   Gcost[start_row][start_col] = 0;
+   // do this first to prevent array-out-of-bounds problems
+   if (nrow < 0 || ncol < 0 || nrow >= s->rows || ncol >= s->cols)
+      return EINA_FALSE;
+   if (!_search_walkable(s, is_walkable, nrow, ncol))
+      return EINA_FALSE;
+   // Don't cut across corners
+   if (dir & 1)
+      return _search_walkable(s, is_walkable, nrow, col) &&
+             _search_walkable(s, is_walkable, row, ncol);
+   return EINA_TRUE;
+}
+
+static void
+_dump_cell(Search *s, int packed, Eina_Bool to_console, Eina_Bool in_game, Ede_Cell_Overlay border)
+{
+   Node *n = &s->nodes[packed];
+   int r, c, pr, pc;
+
+   r = UNPACK_ROW(s, packed);
+   c = UNPACK_COL(s, packed);
+   pr = UNPACK_ROW(s, n->parent);
+   pc = UNPACK_COL(s, n->parent);
 
-   loops = 0;
-   state = ST_SEARCHING;
-   do // until a path is found, max loops reached or destination unreachable.
+   if (to_console)
+      printf("  cell: %d (%d,%d) [G:%d H:%d F:%d] [Parent:%d,%d]\n", packed,
+             r, c, n->g, n->h, n->g + n->h, pr, pc);
+   if (in_game)
    {
-      loops++;
+      ede_gui_cell_overlay_add(border, r, c);
+      ede_gui_cell_overlay_text_set(r, c, n->g + n->h, 1);
+      ede_gui_cell_overlay_text_set(r, c, n->g, 2);
+      ede_gui_cell_overlay_text_set(r, c, n->h, 3);
+      if      (pr == r - 1 && pc == c - 1) ede_gui_cell_overlay_add(OVERLAY_7, r, c);
+      else if (pr == r - 1 && pc == c ) ede_gui_cell_overlay_add(OVERLAY_0, r, c);
+      else if (pr == r - 1 && pc == c + 1) ede_gui_cell_overlay_add(OVERLAY_1, r, c);
+      else if (pr == r && pc == c - 1) ede_gui_cell_overlay_add(OVERLAY_6, r, c);
+      else if (pr == r && pc == c) {}
+      else if (pr == r && pc == c + 1) ede_gui_cell_overlay_add(OVERLAY_2, r, c);
+      else if (pr == r + 1 && pc == c - 1) ede_gui_cell_overlay_add(OVERLAY_5, r, c);
+      else if (pr == r + 1 && pc == c) ede_gui_cell_overlay_add(OVERLAY_4, r, c);
+      else if (pr == r + 1 && pc == c + 1) ede_gui_cell_overlay_add(OVERLAY_3, r, c);
+   }
+}
 
-      // if the open list is not empty, take the first cell of the list.
-      // this is the lowest F cost cell (packed) on the open list.
-      if (eina_list_count(OpenList) != 0)
-      {
-         // pop the first (packed) cell from the open list
-         curPacked = (long)eina_list_data_get(OpenList);
-         OpenList = eina_list_remove_list(OpenList, OpenList);
-         // sorted insert the (packed) cell in the close list
-         CloseList = eina_list_sorted_insert(CloseList, _sort_by_packed,
-                                             (void*)curPacked);
+static void
+_dump_lists(Search *s, Eina_Bool to_console, Eina_Bool in_game)
+{
+   int i, count = 0;
+
+   if (!to_console && !in_game)
+      return;
+
+   // scan the nodes table also for the open cells, as the bucket queue
+   // can contain stale entries
+   if (to_console)
+      printf("OpenList [count: %d]\n", s->heap_count);
+   for (i = 0; i < s->rows * s->cols; i++)
+      if (s->nodes[i].gen == s->gen && s->nodes[i].state == NODE_OPEN)
+         _dump_cell(s, i, to_console, in_game, OVERLAY_BORDER_GREEN);
+   if (to_console) printf("\n");
+
+   // closed cells are not stored in a list, scan the whole nodes table
+   for (i = 0; i < s->rows * s->cols; i++)
+      if (s->nodes[i].gen == s->gen && s->nodes[i].state == NODE_CLOSED)
+         count++;
+   if (to_console)
+      printf("CloseList [count: %d]\n", count);
+   for (i = 0; i < s->rows * s->cols; i++)
+      if (s->nodes[i].gen == s->gen && s->nodes[i].state == NODE_CLOSED)
+         _dump_cell(s, i, to_console, in_game, OVERLAY_BORDER_BLUE);
+   if (to_console) printf("\n");
+}
+
+static void
+_dump_field(Field *f, Eina_Bool to_console, Eina_Bool in_game)
+{
+   int r, c, packed;
 
-         curRow = UNPACK_ROW(curPacked);
-         curCol = UNPACK_COL(curPacked);
-         FD("\nCHECKING CELL: %d,%d [%d]\n", curRow, curCol, curPacked);
+   if (!to_console && !in_game)
+      return;
 
-         // check all the adjacent squares.
-         for (row = curRow - 1; row <= curRow + 1; row++)
+   if (to_console)
+      printf("Field [goal: %d,%d]\n", f->goal / f->cols, f->goal % f->cols);
+   for (r = 0; r < f->rows; r++)
+   {
+      for (c = 0; c < f->cols; c++)
+      {
+         packed = r * f->cols + c;
+         if (to_console)
+            printf("%5d", f->dist[packed] < FIELD_INF ? f->dist[packed] : -1);
+         if (in_game && f->dir[packed] != DIR_NONE)
          {
-            for (col = curCol - 1; col <= curCol + 1; col++)
-            {
-               // do not check ourself
-               if (row == curRow && col == curCol) continue;
-
-               FD("  checking adiacent: %d,%d ..", row, col);
-
-               // If is inside the map (do this first to prevent array-out-of-bounds problems)
-               if (row != -1 && col != -1 && row != LevelRows && col != LevelCols)
-               {
-                  // If is a walkable cell.
-                  if (is_walkable(row, col))
-                  {
-                     adiacentPacked = PACK(row,col);
-                     // If not already on the closed list
-                     if (!eina_list_search_sorted(CloseList, _sort_by_packed, (void*)adiacentPacked)) //FAST
-                     //~ if (!eina_list_data_find(CloseList, (void*)adiacentPacked)) /// !! SLOW !! ... in real I cant see any difference in total time :/
-                     {
-                        // Don't cut across corners
-                        corner_walkable = EINA_TRUE;
-                        if (row == curRow - 1)
-                        {
-                           if (col == curCol - 1) // top-left
-                           {
-                              if (!is_walkable(curRow - 1, curCol) ||
-                                  !is_walkable(curRow, curCol - 1))
-                                corner_walkable = EINA_FALSE;
-                           }
-                           else if (col == curCol + 1) // top-right
-                           {
-                              if (!is_walkable(curRow, curCol + 1) ||
-                                  !is_walkable(curRow - 1, curCol))
-                                corner_walkable = EINA_FALSE;
-                           }
-                        }
-                        else if (row == curRow + 1)
-                        {
-                           if (col == curCol - 1) // bottom-left
-                           {
-                              if (!is_walkable(curRow, curCol - 1) ||
-                                 !is_walkable(curRow + 1, curCol))
-                                 corner_walkable = EINA_FALSE;
-                           }
-                           else if (col == curCol + 1) // bottom-right
-                           {
-                              if (!is_walkable(curRow + 1, curCol) ||
-                                  !is_walkable(curRow, curCol + 1))
-                                 corner_walkable = EINA_FALSE;
-                           }
-                        }
-                        if (corner_walkable)
-                        {
-                           // If not already on the open list, calculate and add it to the open list
-                           if (!eina_list_data_find(OpenList, (void*)adiacentPacked)) // // !! SLOW !! can not use sorted search here because the open list is ordered by Fcost, not packed.
-                           {
-                              FD(". new cell, calc and put in open list.\n");
-                              // calc G cost
-                              Gcost[row][col] =
-                                 (abs(row - curRow) == 1 && abs(col - curCol) == 1) ?
-                                    Gcost[curRow][curCol] + 14 : // cost of going to diagonal cell
-                                    Gcost[curRow][curCol] + 10 ; // cost of going to hortogonal cell
-                              // calc H and F costs
-                              Hcost[row][col] = 10 * (abs(row - target_row) + abs(col - target_col));
-                              Fcost[row][col] = Gcost[row][col] + Hcost[row][col];
-                              // store parent packed position
-                              Parent[row][col] = curPacked;
-                              // add to the open list
-                              OpenList = eina_list_sorted_insert(OpenList, _sort_by_Fcost, (void*)adiacentPacked);// !! SLOW !!
-                           }
-                           else
-                           {
-                              FD(". already on open list, checking if it's a shorter way ..");
-                              // If adjacent cell is already on the open list, check to see if this
-                              // path to that cell from the starting location is a better one.
-                              // If so, change the parent of the cell and its G and F costs.
-
-                              //Figure out the G cost of this possible new path
-                              G = (abs(row - curRow) == 1 && abs(col - curCol) == 1) ?
-                                   Gcost[curRow][curCol] + 14 : // cost of going to diagonal cell
-                                   Gcost[curRow][curCol] + 10 ; // cost of going to hortogonal cell
-
-                              // If this path is shorter (G cost is lower) then change
-                              // the parent cell, G cost and F cost.
-                              if (G < Gcost[row][col]) //if G cost is less,
-                              {
-                                 FD(". yes, updating G and F.\n");
-                                 Parent[row][col] = curPacked;          // change the square's parent
-                                 Gcost[row][col] = G;                   // change the G cost
-                                 Fcost[row][col] = G + Hcost[row][col]; // change F cost
-                                 // because changing the G cost also changes the F cost, we
-                                 // need to change the item's position in the open list to make
-                                 // sure that we maintain a properly ordered open list.
-                                 OpenList = eina_list_remove(OpenList, (void*)adiacentPacked); // !! SLOW !!
-                                 OpenList = eina_list_sorted_insert(OpenList, _sort_by_Fcost, (void*)adiacentPacked); // !! SLOW !!
-                              }else { FD(". no, leave as is.\n"); }
-                           }
-                        } else { FD(". cutting corner, forbidden.\n"); }
-                     } else { FD(". cell on closed list yet, skipping.\n"); }
-                  } else { FD(". cell not walkable, skipping.\n"); }
-               } else { FD(". cell outside map, skipping.\n"); }
-            }
+            ede_gui_cell_overlay_add(OVERLAY_0 + f->dir[packed], r, c);
+            ede_gui_cell_overlay_text_set(r, c, f->dist[packed], 2);
          }
       }
-      else // open_list is empty, there is no path.
-      {
-         state = ST_TARGET_UNREACHABLE;
+      if (to_console) printf("\n");
+   }
+   if (to_console) printf("\n");
+}
+
+/**
+ * Compare two nodes by F cost, used to keep the open heap ordered.
+ * On equal F the node with the lower H (the one nearest to the target) win,
+ * this make the search go deeper instead of expanding all the equal cells.
+ */
+static inline Eina_Bool
+_open_less(const Node *n1, const Node *n2)
+{
+   if (n1->g + n1->h != n2->g + n2->h)
+      return n1->g + n1->h < n2->g + n2->h;
+   return n1->h < n2->h;
+}
+
+/**
+ * Move the cell at heap position 'pos' up until the heap is ordered again.
+ * Used after a push or when the F cost of a cell has been lowered.
+ */
+static void
+_open_sift_up(Search *s, int pos)
+{
+   int packed = s->heap[pos];
+   Node *n = &s->nodes[packed];
+   int parent;
+
+   while (pos > 0)
+   {
+      parent = (pos - 1) / 2;
+      if (!_open_less(n, &s->nodes[s->heap[parent]]))
          break;
-      }
+      s->heap[pos] = s->heap[parent];
+      s->nodes[s->heap[pos]].heap_index = pos;
+      pos = parent;
+   }
+   s->heap[pos] = packed;
+   n->heap_index = pos;
+}
 
-      // if target is in the open list then path has been found.
-      if (eina_list_data_find(OpenList, (void*)PACK(target_row, target_col))) // !! SLOW !!
-      {
-         state = ST_TARGET_FOUND;
+/**
+ * Move the cell at heap position 'pos' down until the heap is ordered again.
+ * Used after the top of the heap has been replaced by the last cell.
+ */
+static void
+_open_sift_down(Search *s, int pos)
+{
+   int packed = s->heap[pos];
+   Node *n = &s->nodes[packed];
+   int child;
+
+   while ((child = pos * 2 + 1) < s->heap_count)
+   {
+      if (child + 1 < s->heap_count &&
+          _open_less(&s->nodes[s->heap[child + 1]], &s->nodes[s->heap[child]]))
+         child++;
+      if (!_open_less(&s->nodes[s->heap[child]], n))
          break;
+      s->heap[pos] = s->heap[child];
+      s->nodes[s->heap[pos]].heap_index = pos;
+      pos = child;
+   }
+   s->heap[pos] = packed;
+   n->heap_index = pos;
+}
+
+/**
+ * Prepare the bucket queue for a new search. The buckets are enough to hold
+ * all the open cells at once: an open cell F cost can't exceed the lowest
+ * one of more than twice the cost of a single step, and the longest step
+ * (a JPS jump) is shorter than rows + cols cells.
+ */
+static Eina_Bool
+_buckets_begin(Search *s)
+{
+   int count = 1;
+
+   while (count <= 2 * 14 * (s->rows + s->cols))
+      count <<= 1;
+   if (!s->buckets || s->buckets_mask != count - 1)
+   {
+      EDE_FREE(s->buckets);
+      s->buckets = malloc(count * sizeof(int));
+      if (!s->buckets)
+      {
+         CRITICAL("Failure to allocate mem for the bucket queue");
+         return EINA_FALSE;
       }
+      s->buckets_mask = count - 1;
+   }
+   memset(s->buckets, 0xFF, count * sizeof(int)); // all -1
+   s->bucket_cur = 0;
+   s->entries_count = 0;
+   return EINA_TRUE;
+}
 
-      if (loops > max_loops)
+/**
+ * Put the cell in the bucket of its F cost, on top of the others (so equal
+ * F cells are expanded the last one first, going deeper). A cell that get a
+ * lower F is just put again in the new bucket, the entry left in the old
+ * one is skipped when popped.
+ */
+static void
+_buckets_push(Search *s, int packed)
+{
+   int f = s->nodes[packed].g + s->nodes[packed].h;
+   int *entries, bucket;
+
+   if (s->entries_count == s->entries_size)
+   {
+      entries = realloc(s->entries, (s->entries_size + s->rows * s->cols) * 2 * sizeof(int));
+      if (!entries)
       {
-         state = ST_MAXLOOPS_REACHED;
-         break;
+         // empty the open list, the search will end as unreachable
+         CRITICAL("Failure to allocate mem for the bucket queue");
+         s->heap_count = 0;
+         return;
       }
+      s->entries = entries;
+      s->entries_size += s->rows * s->cols;
+   }
 
-   }while (1); // break if a path is found, max loops is reached or destination is unreachable.
+   // never happen with a consistent heuristic, just to be safe
+   if (f < s->bucket_cur)
+      s->bucket_cur = f;
 
-end:
-   eina_counter_stop(time_counter, 1);
+   bucket = f & s->buckets_mask;
+   s->entries[s->entries_count * 2] = packed;
+   s->entries[s->entries_count * 2 + 1] = s->buckets[bucket];
+   s->buckets[bucket] = s->entries_count++;
+}
+
+static int
+_buckets_pop(Search *s)
+{
+   int *bucket, entry, packed;
+   Node *n;
 
-   // if target found (and not just_check mode) build the path to follow
-   if (state == ST_TARGET_FOUND && !just_check)
+   while (1)
    {
-      D("\nTarget found, building path to follow.\n");
-      // first insert the target in the path list
-      path = eina_list_append(path, (void*)target_row);
-      path = eina_list_append(path, (void*)target_col);
-      // then insert each hops starting from the target and following the parents
-      curPacked = Parent[target_row][target_col];
-      while (curPacked != startPacked) // while start point reached
+      bucket = &s->buckets[s->bucket_cur & s->buckets_mask];
+      if (*bucket < 0)
       {
-         path = eina_list_prepend(path, (void*)UNPACK_COL(curPacked)); // prepend the new hop to the path list
-         path = eina_list_prepend(path, (void*)UNPACK_ROW(curPacked)); // prepend the new hop to the path list
-         curPacked = Parent[UNPACK_ROW(curPacked)][UNPACK_COL(curPacked)]; // 'follow' the parents
+         s->bucket_cur++;
+         continue;
       }
+      entry = *bucket;
+      *bucket = s->entries[entry * 2 + 1];
+      packed = s->entries[entry * 2];
+      n = &s->nodes[packed];
+      // skip the stale entries, left by cells moved to a lower bucket
+      if (n->state == NODE_OPEN && n->g + n->h == s->bucket_cur)
+         return packed;
    }
+}
 
-   // report
-   D("\n---------   A*  ---------------\n");
-   D("Result: %s\n", state_names[state]);
-   D("Total loops: %d\n", loops);
-   if (path)
+static void
+_open_push(Search *s, int packed)
+{
+   s->nodes[packed].state = NODE_OPEN;
+   if (s->heap_count >= s->open_peak)
+      s->open_peak = s->heap_count + 1;
+   if (s->queue == PATHFINDER_QUEUE_BUCKETS)
    {
-      D("Path (%d total hops):\n", eina_list_count(path));
-      for (l = path; l; l = l->next->next)
-         D(" (%ld,%ld)", (long)l->data, (long)l->next->data);
-      D("\n");
+      s->heap_count++;
+      _buckets_push(s, packed);
+      return;
    }
-   D("\n%s\n", eina_counter_dump(time_counter));
-   D("----------  A* end ----------\n\n");
+   s->heap[s->heap_count] = packed;
+   _open_sift_up(s, s->heap_count++);
+}
 
-   // dump open & close list, to console  and/or  in  game
-   _dump_list(OpenList, info_to_console, info_in_game);
-   _dump_list(CloseList, info_to_console, info_in_game);
+/**
+ * The F cost of an open cell has been lowered, move it in the open list.
+ */
+static void
+_open_decrease(Search *s, int packed)
+{
+   if (s->queue == PATHFINDER_QUEUE_BUCKETS)
+      _buckets_push(s, packed);
+   else
+      _open_sift_up(s, s->nodes[packed].heap_index);
+}
 
-   // free stuff
-   eina_counter_free(time_counter);
-   eina_list_free(OpenList);
-   OpenList = NULL;
-   eina_list_free(CloseList);
-   CloseList = NULL;
+static int
+_open_pop(Search *s)
+{
+   int packed;
 
-   if (just_check)
-      return (void *)(state == ST_TARGET_FOUND);
-   else
-      return path;
+   if (s->queue == PATHFINDER_QUEUE_BUCKETS)
+   {
+      packed = _buckets_pop(s);
+      s->nodes[packed].state = NODE_CLOSED;
+      s->heap_count--;
+      return packed;
+   }
+
+   packed = s->heap[0];
+
+   s->nodes[packed].state = NODE_CLOSED;
+   if (--s->heap_count > 0)
+   {
+      s->heap[0] = s->heap[s->heap_count];
+      _open_sift_down(s, 0);
+   }
+   return packed;
+}
+
+/**
+ * Remove the cell at heap position 'pos' (not only the top one).
+ * The cell get back to the NODE_NEW state.
+ */
+static void
+_open_remove(Search *s, int pos)
+{
+   int packed = s->heap[pos];
+
+   s->nodes[packed].state = NODE_NEW;
+   if (--s->heap_count > pos)
+   {
+      s->heap[pos] = s->heap[s->heap_count];
+      _open_sift_up(s, pos);
+      _open_sift_down(s, s->nodes[s->heap[pos]].heap_index);
+   }
+}
+
+/**
+ * Raise the given heuristic (of the packed cell) to the best lower bound the
+ * landmarks give for the cost to the target. Max of consistent heuristics,
+ * the result is still consistent.
+ * NOTE: a landmark that can't reach one of the two cells don't tell anything
+ */
+static inline int
+_landmarks_heuristic(int packed, int target, int h)
+{
+   const Field *f;
+   int i, d;
+
+   for (i = 0; i < _landmarks.count; i++)
+   {
+      f = &_landmarks.fields[i];
+      if (f->dist[packed] >= FIELD_INF || f->dist[target] >= FIELD_INF)
+         continue;
+      d = f->dist[packed] - f->dist[target];
+      if (d < 0) d = -d;
+      if (d > h) h = d;
+   }
+   return h;
+}
+
+/**
+ * Add (or update) the given cell in the open heap, reached from the parent
+ * cell with the given G cost. Cells in the closed list are left untouched.
+ */
+static void
+_open_relax(Search *s, int parentPacked, int packed, int G,
+            int target_row, int target_col)
+{
+   Node *n = _search_node(s, packed);
+
+   // If already on the closed list
+   if (n->state == NODE_CLOSED)
+   {
+      FD(". cell on closed list yet, skipping.\n");
+      return;
+   }
+
+   // If not already on the open list, calculate and add it to the open list
+   if (n->state == NODE_NEW)
+   {
+      FD(". new cell, calc and put in open list.\n");
+      // calc G and H costs
+      n->g = G;
+      n->h = HEURISTIC(UNPACK_ROW(s, packed), UNPACK_COL(s, packed),
+                       target_row, target_col);
+      if (s->landmarks)
+         n->h = _landmarks_heuristic(packed, s->target, n->h);
+      // store parent packed position
+      n->parent = parentPacked;
+      // add to the open heap
+      _open_push(s, packed);
+   }
+   // If the cell is already on the open list, check to see if this
+   // path to that cell from the starting location is a better one.
+   // If so (G cost is lower), change the parent cell and the G cost.
+   else if (G < n->g)
+   {
+      FD(". already on open list, shorter way, updating G and F.\n");
+      n->parent = parentPacked; // change the square's parent
+      n->g = G;                 // change the G cost
+      // because changing the G cost also lower the F cost, we
+      // need to move the cell up in the open list to keep it ordered.
+      _open_decrease(s, packed);
+   } else { FD(". already on open list, leave as is.\n"); }
+}
+
+/**************   JUMP POINT SEARCH   ****************************************/
+/*
+ * On uniform cost grids most of the cells have many equivalent optimal paths
+ * passing on them; JPS expand only the "jump points": the cells where the
+ * straight (or diagonal) run must stop because a wall open a new way that
+ * can not be reached better from the parent. The rules here are the ones
+ * for grids where diagonal moves can't cut across corners, so the found
+ * paths have the same cost of the plain A* ones.
+ */
+static inline Eina_Bool
+_walkable(Search *s, Eina_Bool (*is_walkable)(int row, int col), int row, int col)
+{
+   if (row < 0 || col < 0 || row >= s->rows || col >= s->cols)
+      return EINA_FALSE;
+   return _search_walkable(s, is_walkable, row, col);
+}
+
+/**
+ * Run from the given cell in the given direction until a jump point is
+ * found: the target, a cell with forced neighbours, or (moving diagonally)
+ * a cell from where a straight run find a jump point.
+ * @return the packed jump point, or -1 if the run hit a wall
+ */
+static int
+_jps_jump(Search *s, Eina_Bool (*is_walkable)(int row, int col),
+          int row, int col, int dir, int targetPacked)
+{
+   int drow = dir_row[dir];
+   int dcol = dir_col[dir];
+
+   while (1)
+   {
+      if (!_move_allowed(s, is_walkable, row, col, dir))
+         return -1;
+      row += drow;
+      col += dcol;
+
+      if (PACK(s, row, col) == targetPacked)
+         return targetPacked;
+
+      if (dir & 1)
+      {
+         // diagonal: stop here if one of the two straight runs find something
+         if (_jps_jump(s, is_walkable, row, col, DIR_ROTATE(dir, -1), targetPacked) >= 0 ||
+             _jps_jump(s, is_walkable, row, col, DIR_ROTATE(dir, 1), targetPacked) >= 0)
+            return PACK(s, row, col);
+      }
+      else if (drow == 0)
+      {
+         // horizontal: a side cell that was behind a wall is a forced neighbour
+         if ((_walkable(s, is_walkable, row - 1, col) && !_walkable(s, is_walkable, row - 1, col - dcol)) ||
+             (_walkable(s, is_walkable, row + 1, col) && !_walkable(s, is_walkable, row + 1, col - dcol)))
+            return PACK(s, row, col);
+      }
+      else
+      {
+         // vertical: same as above
+         if ((_walkable(s, is_walkable, row, col - 1) && !_walkable(s, is_walkable, row - drow, col - 1)) ||
+             (_walkable(s, is_walkable, row, col + 1) && !_walkable(s, is_walkable, row - drow, col + 1)))
+            return PACK(s, row, col);
+      }
+   }
+}
+
+/**
+ * Expand the given cell: jump in all the directions that can not be reached
+ * better from the parent, and relax the found jump points.
+ */
+static void
+_jps_expand(Search *s, Eina_Bool (*is_walkable)(int row, int col),
+            int curPacked, int target_row, int target_col)
+{
+   Node *cur = &s->nodes[curPacked];
+   int curRow = UNPACK_ROW(s, curPacked);
+   int curCol = UNPACK_COL(s, curPacked);
+   int targetPacked = PACK(s, target_row, target_col);
+   int prow, pcol, dir, i, jp, count;
+   int dirs[8];
+
+   if (cur->parent == curPacked)
+   {
+      // the start cell, no parent: go everywhere
+      for (i = 0; i < 8; i++) dirs[i] = i;
+      count = 8;
+   }
+   else
+   {
+      // the direction we are travelling along
+      prow = UNPACK_ROW(s, cur->parent);
+      pcol = UNPACK_COL(s, cur->parent);
+      for (dir = 0; dir < 8; dir++)
+         if (dir_row[dir] == (curRow > prow) - (curRow < prow) &&
+             dir_col[dir] == (curCol > pcol) - (curCol < pcol))
+            break;
+
+      count = 0;
+      dirs[count++] = dir;
+      if (dir & 1)
+      {
+         // diagonal: forward and the two straight components
+         dirs[count++] = DIR_ROTATE(dir, -1);
+         dirs[count++] = DIR_ROTATE(dir, 1);
+      }
+      else
+      {
+         // straight: forward, the two forward diagonals and the two sides
+         dirs[count++] = DIR_ROTATE(dir, -1);
+         dirs[count++] = DIR_ROTATE(dir, 1);
+         dirs[count++] = DIR_ROTATE(dir, -2);
+         dirs[count++] = DIR_ROTATE(dir, 2);
+      }
+   }
+
+   for (i = 0; i < count; i++)
+   {
+      jp = _jps_jump(s, is_walkable, curRow, curCol, dirs[i], targetPacked);
+      if (jp < 0) continue;
+      FD("  jump point: %d,%d ..", UNPACK_ROW(s, jp), UNPACK_COL(s, jp));
+      _open_relax(s, curPacked, jp,
+                  cur->g + HEURISTIC(curRow, curCol,
+                                     UNPACK_ROW(s, jp), UNPACK_COL(s, jp)),
+                  target_row, target_col);
+   }
+}
+
+/**
+ * Account a finished request in the statistics.
+ * @param elapsed the time it took (in seconds)
+ */
+static void
+_stats_add(Ede_Pathfinder_Query query, double elapsed, int expanded, int open_peak)
+{
+   int usec = elapsed * 1000000, limit = 16, bucket = 0;
+
+   while (bucket < EDE_PATHFINDER_LATENCY_BUCKETS - 1 && usec >= limit)
+   {
+      bucket++;
+      limit *= 4;
+   }
+   _stats.calls[query]++;
+   _stats.expanded[query] += expanded;
+   _stats.latency[query][bucket]++;
+   if (open_peak > _stats.open_peak)
+      _stats.open_peak = open_peak;
+}
+
+/* Externally accessible functions */
+EAPI Eina_Bool
+ede_pathfinder_init(void)
+{
+   DBG(" ");
+   memset(&_search, 0, sizeof(Search));
+   memset(&_job_search, 0, sizeof(Search));
+   memset(&_search_back, 0, sizeof(Search));
+   memset(&_stats, 0, sizeof(_stats));
+   _queue = PATHFINDER_QUEUE_HEAP;
+   _smooth = EINA_FALSE;
+   _job_running = NULL;
+   _jobs = NULL;
+   _jobs_budget = PATH_JOBS_BUDGET;
+   _workers = ecore_thread_max_get();
+   _jobs_threads = 0;
+   _jobs_in_workers = eina_hash_new(EINA_KEY_LENGTH(_job_key_length),
+                                    EINA_KEY_CMP(_job_key_cmp),
+                                    EINA_KEY_HASH(_job_key_hash),
+                                    NULL, 5);
+   if (!_jobs_in_workers)
+   {
+      CRITICAL("Failure to allocate mem for the pathfinder jobs");
+      return EINA_FALSE;
+   }
+   _snapshot = NULL;
+   _map = NULL;
+   _map_is_walkable = NULL;
+   _map_dirs_table_init();
+   memset(&_field, 0, sizeof(Field));
+   memset(&_landmarks, 0, sizeof(Landmarks));
+   memset(&_hpa, 0, sizeof(Hpa));
+   memset(&_blocking, 0, sizeof(Blocking));
+   memset(_cache, 0, sizeof(_cache));
+   _routes = _routes_jobs = NULL;
+   info_to_console = info_in_game = EINA_FALSE;
+   return EINA_TRUE;
+}
+
+EAPI Eina_Bool
+ede_pathfinder_shutdown(void)
+{
+   Ede_Path_Job *job;
+
+   DBG(" ");
+   // the jobs still in the workers are freed when the workers end
+   ede_pathfinder_routes_clear();
+   EINA_LIST_FREE(_jobs, job)
+      ede_pathfinder_job_cancel(job);
+   eina_hash_free(_jobs_in_workers);
+   _jobs_in_workers = NULL;
+   if (_snapshot) _snapshot_unref(_snapshot);
+   _snapshot = NULL;
+   _search_free(&_search);
+   _search_free(&_job_search);
+   _search_free(&_search_back);
+   ede_pathfinder_cache_clear();
+   EDE_FREE(_field.dist);
+   EDE_FREE(_field.rhs);
+   EDE_FREE(_field.dir);
+   ede_pathfinder_landmarks_build(0, 0, 0, NULL);
+   _hpa_free(&_hpa);
+   _blocking_free(&_blocking);
+   return EINA_TRUE;
+}
+
+/**
+ * Alloc a new path, with room for the given number of hops, in a single block.
+ */
+static Ede_Path *
+_path_alloc(int count)
+{
+   Ede_Path *path;
+
+   path = calloc(1, sizeof(Ede_Path) + count * sizeof(int));
+   if (!path)
+   {
+      CRITICAL("Failure to allocate mem for a path of %d hops", count);
+      return NULL;
+   }
+   path->refcount = 1;
+   path->count = count;
+   return path;
+}
+
+/**
+ * Start a new A* (or JPS) search in the given context, the search is then
+ * run with _astar_run(). The queue and smooth settings are given by the
+ * caller, the workers can't read the global ones.
+ * @return EINA_FALSE if start or target are not walkable
+ */
+static Eina_Bool
+_astar_begin(Search *s, int start_row, int start_col,
+             int target_row, int target_col,
+             Eina_Bool (*is_walkable)(int row, int col),
+             Ede_Pathfinder_Mode mode,
+             Ede_Pathfinder_Queue queue, Eina_Bool smooth)
+{
+   Node *n;
+
+   // invalidate all the nodes of the previous search
+   // NOTE: the workers give NULL is_walkable, they already set the bitmap
+   _search_begin(s, is_walkable);
+   s->start = PACK(s, start_row, start_col);
+   s->target = PACK(s, target_row, target_col);
+   s->target_row = target_row;
+   s->target_col = target_col;
+   s->is_walkable = is_walkable;
+   s->mode = mode;
+   s->loops = 0;
+   s->smooth = smooth;
+   if (queue == PATHFINDER_QUEUE_BUCKETS && _buckets_begin(s))
+      s->queue = PATHFINDER_QUEUE_BUCKETS;
+   // the landmarks tables are only kept for the main grid (not for the
+   // snapshots the workers search on, they don't even look at them)
+   s->landmarks = (is_walkable && _landmarks.count > 0 &&
+                   is_walkable == _landmarks.fields[0].is_walkable &&
+                   _landmarks.fields[0].rows == s->rows &&
+                   _landmarks.fields[0].cols == s->cols);
+
+   // Check to see if start and target are walkable
+   if (!_search_walkable(s, is_walkable, start_row, start_col) ||
+       !_search_walkable(s, is_walkable, target_row, target_col))
+      return EINA_FALSE;
+
+   // add the starting location to the open list of cells to be checked
+   // and set its G cost to 0
+   n = _search_node(s, s->start);
+   n->g = 0;
+   n->h = HEURISTIC(start_row, start_col, target_row, target_col);
+   if (s->landmarks)
+      n->h = _landmarks_heuristic(s->start, s->target, n->h);
+   n->parent = s->start;
+   _open_push(s, s->start);
+   return EINA_TRUE;
+}
+
+/**
+ * Run the search for at most max_loops steps (cells expanded). All the
+ * state is kept in the context, so the search can be resumed calling this
+ * again.
+ * @return ST_TARGET_FOUND, ST_TARGET_UNREACHABLE or ST_SEARCHING if the
+ *         search is not finished yet
+ */
+static int
+_astar_run(Search *s, int max_loops)
+{
+   Node *cur;
+   int curRow, curCol, curPacked; // point to the cell we are checking
+   int row, col, dir; // used to loop the 8 adiacent cell
+   unsigned int dirs; // the allowed moves, when using the bitmap
+
+   while (max_loops-- > 0)
+   {
+      // if the open list is empty there is no path.
+      if (s->heap_count == 0)
+         return ST_TARGET_UNREACHABLE;
+
+      // pop the lowest F cost (packed) cell from the top of the open heap,
+      // this also mark it as closed
+      curPacked = _open_pop(s);
+      s->loops++;
+
+      // if the target is the cell just popped then the path has been found.
+      // NOTE: checking the target when it is popped (and not when it is
+      // pushed) ensure that the found path is the shortest one.
+      if (curPacked == s->target)
+         return ST_TARGET_FOUND;
+
+      cur = &s->nodes[curPacked];
+      curRow = UNPACK_ROW(s, curPacked);
+      curCol = UNPACK_COL(s, curPacked);
+      FD("\nCHECKING CELL: %d,%d [%d]\n", curRow, curCol, curPacked);
+
+      // JPS only put the jump points in the open list
+      if (s->mode == PATHFINDER_JPS)
+      {
+         _jps_expand(s, s->is_walkable, curPacked, s->target_row, s->target_col);
+         continue;
+      }
+
+      // with the bitmap all the moves allowed are known at once
+      if (s->map)
+      {
+         dirs = _map_dirs(s->map, curRow, curCol);
+         for (dir = 0; dirs; dir++, dirs >>= 1)
+            if (dirs & 1)
+               _open_relax(s, curPacked,
+                           PACK(s, curRow + dir_row[dir], curCol + dir_col[dir]),
+                           cur->g + DIR_COST(dir),
+                           s->target_row, s->target_col);
+         continue;
+      }
+
+      // check all the adjacent squares.
+      for (dir = 0; dir < 8; dir++)
+      {
+         row = curRow + dir_row[dir];
+         col = curCol + dir_col[dir];
+         FD("  checking adiacent: %d,%d ..", row, col);
+
+         // If inside the map, walkable and not cutting across corners
+         if (!_move_allowed(s, s->is_walkable, curRow, curCol, dir))
+         {
+            FD(". not walkable, skipping.\n");
+            continue;
+         }
+
+         _open_relax(s, curPacked, PACK(s, row, col), cur->g + DIR_COST(dir),
+                     s->target_row, s->target_col);
+      }
+   }
+   return ST_SEARCHING;
+}
+
+/**************   SMOOTHING   ***********************************************/
+/* Walk of the cells crossed by the segment between two cell centers, in the
+ * order they are crossed. err tell if the segment leave the current cell on
+ * a side, on the other one or exactly on a corner. */
+typedef struct _Line Line;
+struct _Line
+{
+   int row, col;       // the current cell
+   int to_row, to_col; // the last cell
+   int drow, dcol, srow, scol, err;
+};
+#define LINE_END 0    // the last cell was reached
+#define LINE_SIDE 1   // stepped to the next cell through a side
+#define LINE_CORNER 2 // stepped to the next cell through a corner
+
+static inline void
+_line_begin(Line *l, int row, int col, int to_row, int to_col)
+{
+   l->row = row;
+   l->col = col;
+   l->to_row = to_row;
+   l->to_col = to_col;
+   l->srow = to_row > row ? 1 : -1;
+   l->scol = to_col > col ? 1 : -1;
+   l->drow = abs(to_row - row) * 2;
+   l->dcol = abs(to_col - col) * 2;
+   l->err = (l->dcol - l->drow) / 2;
+}
+
+static inline int
+_line_step(Line *l)
+{
+   if (l->row == l->to_row && l->col == l->to_col)
+      return LINE_END;
+   if (l->err > 0)
+   {
+      l->col += l->scol;
+      l->err -= l->drow;
+      return LINE_SIDE;
+   }
+   if (l->err < 0)
+   {
+      l->row += l->srow;
+      l->err += l->dcol;
+      return LINE_SIDE;
+   }
+   l->row += l->srow;
+   l->col += l->scol;
+   l->err += l->dcol - l->drow;
+   return LINE_CORNER;
+}
+
+/**
+ * Check if an enemy can walk straight from the center of a cell to the center
+ * of the other one: all the cells crossed by the segment must be walkable,
+ * and where the segment pass exactly on a corner also the two cells that
+ * share the corner (the same no corner cutting rule of the diagonal moves).
+ */
+static Eina_Bool
+_line_of_sight(Search *s, Eina_Bool (*is_walkable)(int row, int col),
+               int row, int col, int to_row, int to_col)
+{
+   Line l;
+   int step;
+
+   _line_begin(&l, row, col, to_row, to_col);
+   while ((step = _line_step(&l)) != LINE_END)
+   {
+      if (step == LINE_CORNER &&
+          (!_search_walkable(s, is_walkable, l.row, l.col - l.scol) ||
+           !_search_walkable(s, is_walkable, l.row - l.srow, l.col)))
+         return EINA_FALSE;
+      if (!_search_walkable(s, is_walkable, l.row, l.col))
+         return EINA_FALSE;
+   }
+   return EINA_TRUE;
+}
+
+/**
+ * String pulling: drop all the hops that can be skipped walking straight
+ * from the previous kept one, so a staircase of cells become a few any angle
+ * segments. The path must not be shared yet, it is shrinked in place.
+ * @return the smoothed path (the given one is not valid anymore)
+ */
+static Ede_Path *
+_path_smooth(Search *s, Eina_Bool (*is_walkable)(int row, int col),
+             Ede_Path *path, int start_row, int start_col)
+{
+   Ede_Path *smooth;
+   int row = start_row, col = start_col; // the last hop kept
+   int i, count = 0;
+
+   for (i = 0; i < path->count; i++)
+   {
+      // keep the hop if the next one can't be seen from the last one kept
+      if (i == path->count - 1 ||
+          !_line_of_sight(s, is_walkable, row, col,
+                          EDE_PATH_HOP_ROW(path->hops[i + 1]),
+                          EDE_PATH_HOP_COL(path->hops[i + 1])))
+      {
+         path->hops[count++] = path->hops[i];
+         row = EDE_PATH_HOP_ROW(path->hops[i]);
+         col = EDE_PATH_HOP_COL(path->hops[i]);
+      }
+   }
+
+   D("Path smoothed from %d to %d hops\n", path->count, count);
+   path->count = count;
+   smooth = realloc(path, sizeof(Ede_Path) + count * sizeof(int));
+   return smooth ? smooth : path;
+}
+
+/**
+ * Build the path to follow from a search that found the target.
+ */
+static Ede_Path *
+_astar_path_build(Search *s)
+{
+   Ede_Path *path;
+   int curRow, curCol, curPacked, row, col, count, i, steps;
+
+   D("\nTarget found, building path to follow.\n");
+   // count the hops following the parents from the target, the start
+   // cell itself is not part of the path. Parents are adiacent cells, or
+   // jump points on a straight (or diagonal) line with JPS.
+   count = 0;
+   for (curPacked = s->target; curPacked != s->start;
+        curPacked = s->nodes[curPacked].parent)
+   {
+      row = abs(UNPACK_ROW(s, curPacked) - UNPACK_ROW(s, s->nodes[curPacked].parent));
+      col = abs(UNPACK_COL(s, curPacked) - UNPACK_COL(s, s->nodes[curPacked].parent));
+      count += row > col ? row : col;
+   }
+
+   // then fill the path backward, with the same walk, putting in all the
+   // cells between a parent and its child
+   path = _path_alloc(count);
+   if (!path)
+      return NULL;
+   i = count;
+   for (curPacked = s->target; curPacked != s->start;
+        curPacked = s->nodes[curPacked].parent)
+   {
+      curRow = UNPACK_ROW(s, curPacked);
+      curCol = UNPACK_COL(s, curPacked);
+      row = UNPACK_ROW(s, s->nodes[curPacked].parent);
+      col = UNPACK_COL(s, s->nodes[curPacked].parent);
+      steps = abs(curRow - row) > abs(curCol - col) ?
+              abs(curRow - row) : abs(curCol - col);
+      while (steps--)
+      {
+         path->hops[--i] = EDE_PATH_HOP_PACK(curRow, curCol);
+         curRow -= (curRow > row) - (curRow < row);
+         curCol -= (curCol > col) - (curCol < col);
+      }
+   }
+   if (s->smooth)
+      path = _path_smooth(s, s->is_walkable, path,
+                          UNPACK_ROW(s, s->start), UNPACK_COL(s, s->start));
+   return path;
+}
+
+/**************   BIDIRECTIONAL   *******************************************/
+/**
+ * Bidirectional A*: a forward search from the start and a backward one from
+ * the target, each on its own context, the one with the smaller open list
+ * expanded first. Both use the average of the two heuristics, that is still
+ * consistent, with the costs doubled to keep everything integer:
+ * F = 2 * G + (h_to_target - h_to_start) forward, the opposite backward.
+ * Every cell reached by both sides is a meeting point, the search stop when
+ * the best meeting can't be improved anymore (the sum of the two lowest F
+ * is not lower than its doubled cost), or at the first meeting in
+ * just_check mode.
+ * @return ST_TARGET_FOUND (meet is the best meeting cell),
+ *         ST_TARGET_UNREACHABLE or ST_MAXLOOPS_REACHED
+ */
+static int
+_bidir_run(Search *fw, Search *bw, int start_row, int start_col,
+           int target_row, int target_col,
+           Eina_Bool (*is_walkable)(int row, int col),
+           int max_loops, Eina_Bool just_check, int *meet)
+{
+   Search *s, *other;
+   Node *cur, *n, *o;
+   int best = INT_MAX; // doubled cost of the best meeting found so far
+   int curPacked, packed, curRow, curCol, row, col, dir, G;
+
+   _search_begin(fw, is_walkable);
+   _search_begin(bw, is_walkable);
+   fw->start = bw->target = PACK(fw, start_row, start_col);
+   fw->target = bw->start = PACK(fw, target_row, target_col);
+   fw->is_walkable = bw->is_walkable = is_walkable;
+   fw->loops = 0;
+
+   if (!_search_walkable(fw, is_walkable, start_row, start_col) ||
+       !_search_walkable(fw, is_walkable, target_row, target_col))
+      return ST_TARGET_UNREACHABLE;
+   if (fw->start == fw->target)
+   {
+      *meet = fw->start;
+      return ST_TARGET_FOUND;
+   }
+
+   n = _search_node(fw, fw->start);
+   n->g = 0;
+   n->h = HEURISTIC(start_row, start_col, target_row, target_col);
+   n->parent = fw->start;
+   _open_push(fw, fw->start);
+   n = _search_node(bw, bw->start);
+   n->g = 0;
+   n->h = HEURISTIC(target_row, target_col, start_row, start_col);
+   n->parent = bw->start;
+   _open_push(bw, bw->start);
+
+   while (fw->heap_count > 0 && bw->heap_count > 0)
+   {
+      // no meeting better than the best one can be found anymore
+      if (best < INT_MAX && (just_check ||
+          fw->nodes[fw->heap[0]].g + fw->nodes[fw->heap[0]].h +
+          bw->nodes[bw->heap[0]].g + bw->nodes[bw->heap[0]].h >= best))
+         break;
+      if (fw->loops++ >= max_loops)
+         return ST_MAXLOOPS_REACHED;
+
+      // expand the side with less open cells
+      s = fw->heap_count <= bw->heap_count ? fw : bw;
+      other = s == fw ? bw : fw;
+      curPacked = _open_pop(s);
+      cur = &s->nodes[curPacked];
+      curRow = UNPACK_ROW(s, curPacked);
+      curCol = UNPACK_COL(s, curPacked);
+
+      for (dir = 0; dir < 8; dir++)
+      {
+         if (!_move_allowed(s, is_walkable, curRow, curCol, dir))
+            continue;
+         row = curRow + dir_row[dir];
+         col = curCol + dir_col[dir];
+         packed = PACK(s, row, col);
+         n = _search_node(s, packed);
+         if (n->state == NODE_CLOSED)
+            continue;
+
+         G = cur->g + 2 * DIR_COST(dir);
+         if (n->state == NODE_NEW)
+         {
+            n->g = G;
+            n->h = s == fw ?
+               HEURISTIC(row, col, target_row, target_col) - HEURISTIC(row, col, start_row, start_col) :
+               HEURISTIC(row, col, start_row, start_col) - HEURISTIC(row, col, target_row, target_col);
+            n->parent = curPacked;
+            _open_push(s, packed);
+         }
+         else if (G < n->g)
+         {
+            n->g = G;
+            n->parent = curPacked;
+            _open_decrease(s, packed);
+         }
+         else
+            continue;
+
+         // reached by the other side too ? a new meeting
+         o = &other->nodes[packed];
+         if (o->gen == other->gen && o->state != NODE_NEW && n->g + o->g < best)
+         {
+            best = n->g + o->g;
+            *meet = packed;
+         }
+      }
+   }
+
+   return best < INT_MAX ? ST_TARGET_FOUND : ST_TARGET_UNREACHABLE;
+}
+
+/**
+ * Build the path of a bidirectional search, joining the forward parents
+ * (from the start to the meeting cell) and the backward ones (from the
+ * meeting cell to the target).
+ */
+static Ede_Path *
+_bidir_path_build(Search *fw, Search *bw, int meet)
+{
+   Ede_Path *path;
+   int packed, forward = 0, count, i;
+
+   for (packed = meet; packed != fw->start; packed = fw->nodes[packed].parent)
+      forward++;
+   count = forward;
+   for (packed = meet; packed != bw->start; packed = bw->nodes[packed].parent)
+      count++;
+
+   path = _path_alloc(count);
+   if (!path)
+      return NULL;
+   i = forward;
+   for (packed = meet; packed != fw->start; packed = fw->nodes[packed].parent)
+      path->hops[--i] = EDE_PATH_HOP_PACK(UNPACK_ROW(fw, packed),
+                                          UNPACK_COL(fw, packed));
+   i = forward;
+   for (packed = meet; packed != bw->start; )
+   {
+      packed = bw->nodes[packed].parent;
+      path->hops[i++] = EDE_PATH_HOP_PACK(UNPACK_ROW(fw, packed),
+                                          UNPACK_COL(fw, packed));
+   }
+   if (_smooth)
+      path = _path_smooth(fw, fw->is_walkable, path,
+                          UNPACK_ROW(fw, fw->start), UNPACK_COL(fw, fw->start));
+   return path;
+}
+
+/**
+ * Find the shortest path from start to target.
+ * @param mode PATHFINDER_JPS to use Jump Point Search (same path cost, much
+ *        less expanded cells on open maps), PATHFINDER_BIDIR to search from
+ *        both the ends, any other mode for plain A*
+ * @return the path to follow (the start cell excluded), NULL if the target
+ *         is unreachable. In just_check mode only EINA_TRUE/EINA_FALSE.
+ */
+EAPI Ede_Path *
+ede_pathfinder(int level_rows, int level_cols,
+               int start_row, int start_col,
+               int target_row, int target_col,
+               Eina_Bool (*is_walkable)(int row, int col),
+               Ede_Pathfinder_Mode mode,
+               int max_loops, Eina_Bool just_check)
+{
+   Search *s = &_search;
+   Ede_Path *path = NULL; // RETURNED. The hops that make the route to follow for reaching the target
+   int state, meet, i, open_peak;
+   double start_time;
+
+   if (max_loops < 1) max_loops = level_rows * level_cols;
+
+   D("\n----------  A *  -----------\n");
+   D("From: %d,%d To: %d,%d [map: %d,%d][max loops: %d][%s]\n\n", start_row, start_col,
+           target_row, target_col, level_rows, level_cols, max_loops,
+           ede_pathfinder_mode_name_get(mode));
+
+   start_time = ecore_time_get();
+
+   // alloc/realloc the nodes table if the grid size is changed
+   if (!_search_grid_set(s, level_rows, level_cols))
+      return NULL;
+
+   if (mode == PATHFINDER_BIDIR)
+   {
+      // search from both the ends, then join the two halves
+      if (!_search_grid_set(&_search_back, level_rows, level_cols))
+         return NULL;
+      state = _bidir_run(s, &_search_back, start_row, start_col,
+                         target_row, target_col, is_walkable,
+                         max_loops, just_check, &meet);
+      if (state == ST_TARGET_FOUND && !just_check)
+         path = _bidir_path_build(s, &_search_back, meet);
+      open_peak = s->open_peak + _search_back.open_peak; // both open at once
+   }
+   else
+   {
+      // search until a path is found, max loops reached or destination unreachable.
+      if (!_astar_begin(s, start_row, start_col, target_row, target_col,
+                        is_walkable, mode, _queue, _smooth))
+         state = ST_TARGET_UNREACHABLE;
+      else if ((state = _astar_run(s, max_loops)) == ST_SEARCHING)
+         state = ST_MAXLOOPS_REACHED;
+
+      // if target found (and not just_check mode) build the path to follow
+      if (state == ST_TARGET_FOUND && !just_check)
+         path = _astar_path_build(s);
+      open_peak = s->open_peak;
+   }
+   _stats.mode_expanded[mode] += s->loops;
+   _stats.searches[mode]++;
+   _stats_add(just_check ? PATHFINDER_QUERY_CHECK : PATHFINDER_QUERY_PATH,
+              ecore_time_get() - start_time, s->loops, open_peak);
+
+   // report
+   D("\n---------   A*  ---------------\n");
+   D("Result: %s\n", state_names[state]);
+   D("Total loops: %d\n", s->loops);
+   if (path)
+   {
+      D("Path (%d total hops):\n", path->count);
+      for (i = 0; i < path->count; i++)
+         D(" (%d,%d)", EDE_PATH_HOP_ROW(path->hops[i]),
+                       EDE_PATH_HOP_COL(path->hops[i]));
+      D("\n");
+   }
+   D("Time: %.3f ms\n", (ecore_time_get() - start_time) * 1000);
+   D("----------  A* end ----------\n\n");
+
+   // dump open & close list, to console  and/or  in  game
+   _dump_lists(s, info_to_console, info_in_game);
+
+   if (just_check)
+      return (void *)(state == ST_TARGET_FOUND);
+   else
+      return path;
+}
+
+/**************   REACHABILITY   *********************************************/
+/**
+ * The flood fill of ede_pathfinder_reachable_check(), the flooded cells are
+ * left in s->loops.
+ */
+static Eina_Bool
+_reachable_flood(Search *s, int level_rows, int level_cols,
+                 int goal_row, int goal_col,
+                 Eina_List **starts, int starts_count,
+                 Eina_Bool (*is_walkable)(int row, int col))
+{
+   Eina_List *l;
+   Node *n;
+   int remaining = 0, head = 0, curPacked, packed, row, col, dir, i;
+
+   if (!_search_grid_set(s, level_rows, level_cols))
+      return EINA_FALSE;
+   _search_begin(s, is_walkable);
+
+   // mark all the start cells as OPEN: the ones still to be reached
+   for (i = 0; i < starts_count; i++)
+      for (l = starts[i]; l && l->next; l = l->next->next)
+      {
+         row = (int)(long)eina_list_data_get(l);
+         col = (int)(long)eina_list_data_get(l->next);
+         if (!is_walkable(row, col))
+            return EINA_FALSE;
+         n = _search_node(s, PACK(s, row, col));
+         if (n->state == NODE_NEW)
+         {
+            n->state = NODE_OPEN;
+            remaining++;
+         }
+      }
+   if (remaining == 0)
+      return EINA_TRUE;
+   if (!is_walkable(goal_row, goal_col))
+      return EINA_FALSE;
+
+   // breadth first flood, using the heap array as a plain FIFO queue:
+   // every cell is queued (and marked CLOSED) only once
+   packed = PACK(s, goal_row, goal_col);
+   n = _search_node(s, packed);
+   if (n->state == NODE_OPEN) remaining--;
+   n->state = NODE_CLOSED;
+   s->heap[s->heap_count++] = packed;
+
+   while (head < s->heap_count && remaining > 0)
+   {
+      curPacked = s->heap[head++];
+      row = UNPACK_ROW(s, curPacked);
+      col = UNPACK_COL(s, curPacked);
+      for (dir = 0; dir < 8; dir++)
+      {
+         if (!_move_allowed(s, is_walkable, row, col, dir))
+            continue;
+         packed = PACK(s, row + dir_row[dir], col + dir_col[dir]);
+         n = _search_node(s, packed);
+         if (n->state == NODE_CLOSED)
+            continue;
+         if (n->state == NODE_OPEN) remaining--;
+         n->state = NODE_CLOSED;
+         s->heap[s->heap_count++] = packed;
+      }
+   }
+
+   D("Reachability check: %d starts not reached, %d cells flooded\n",
+     remaining, s->heap_count);
+   s->loops = head;
+   s->heap_count = 0;
+   return remaining == 0;
+}
+
+/**
+ * Check that the goal can be reached from all the given start cells.
+ * Instead of a search for each start, a single flood fill from the goal is
+ * run (moves are symmetric), stopping as soon as all the starts are reached.
+ * Cost is O(cells) however many starts there are.
+ * @param starts array of lists of start cells (row, col, row, col, ...)
+ * @param starts_count number of lists in the array
+ */
+EAPI Eina_Bool
+ede_pathfinder_reachable_check(int level_rows, int level_cols,
+                               int goal_row, int goal_col,
+                               Eina_List **starts, int starts_count,
+                               Eina_Bool (*is_walkable)(int row, int col))
+{
+   double start_time = ecore_time_get();
+   Eina_Bool reachable;
+
+   reachable = _reachable_flood(&_search, level_rows, level_cols,
+                                goal_row, goal_col, starts, starts_count,
+                                is_walkable);
+   _stats_add(PATHFINDER_QUERY_REACHABLE, ecore_time_get() - start_time,
+              _search.loops, 0);
+   return reachable;
+}
+
+/**
+ * Walkable check with the excluded area considered as taken.
+ */
+static Eina_Bool
+_excluded_walkable_get(int row, int col)
+{
+   if (row >= _excluded_row && row < _excluded_row + _excluded_rows &&
+       col >= _excluded_col && col < _excluded_col + _excluded_cols)
+      return EINA_FALSE;
+   return _excluded_is_walkable(row, col);
+}
+
+static inline Eina_Bool
+_blocking_walkable(Search *s, Eina_Bool (*is_walkable)(int row, int col),
+                   int row, int col)
+{
+   if (row < 0 || col < 0 || row >= s->rows || col >= s->cols)
+      return EINA_FALSE;
+   return _search_walkable(s, is_walkable, row, col);
+}
+
+/**
+ * Count the runs of walkable cells in the ring of cells around the area.
+ * The ring is a loop of cells each one orthogonally adiacent to the next.
+ */
+static int
+_blocking_ring_runs(Search *s, Eina_Bool (*is_walkable)(int row, int col),
+                    int row, int col, int rows, int cols)
+{
+   int r = row - 1, c = col - 1, len, i, runs = 0;
+   Eina_Bool walkable, prev;
+
+   // clockwise from the top-left corner: right, down, left, up
+   len = 2 * (rows + cols) + 4;
+   prev = _blocking_walkable(s, is_walkable, row, col - 1); // the last one
+   for (i = 0; i < len; i++)
+   {
+      walkable = _blocking_walkable(s, is_walkable, r, c);
+      if (walkable && !prev) runs++;
+      prev = walkable;
+      if (r == row - 1 && c < col + cols) c++;
+      else if (c == col + cols && r < row + rows) r++;
+      else if (r == row + rows && c > col - 1) c--;
+      else r--;
+   }
+   return runs;
+}
+
+/**
+ * Check if the cell hangs below the area in the flood tree, the way home in
+ * the tree is cut then.
+ */
+static inline Eina_Bool
+_blocking_under_area(Blocking *b, const int *area, int area_count, int packed)
+{
+   int i;
+
+   for (i = 0; i < area_count; i++)
+      if (area[i] >= 0 && b->pre[packed] >= b->pre[area[i]] &&
+          b->pre[packed] < b->pre[area[i]] + b->size[area[i]])
+         return EINA_TRUE;
+   return EINA_FALSE;
+}
+
+/**
+ * Flood from the given cell without entering the area, until a cell whose
+ * way home in the tree do not pass through the area is met (or a cell met
+ * by a previous flood for the same area, stamped from first on, that did).
+ * @return EINA_FALSE if the cell is cut off from the goal by the area
+ */
+static Eina_Bool
+_blocking_escape(Blocking *b, Search *s,
+                 Eina_Bool (*is_walkable)(int row, int col),
+                 const int *area, int area_count, int row, int col,
+                 int packed, unsigned int first, unsigned int stamp)
+{
+   int head = 0, count = 0, curPacked, r, c, dir;
+
+   b->seen[packed] = stamp;
+   s->heap[count++] = packed;
+   while (head < count)
+   {
+      curPacked = s->heap[head++];
+      r = UNPACK_ROW(s, curPacked);
+      c = UNPACK_COL(s, curPacked);
+      if (!_blocking_under_area(b, area, area_count, curPacked))
+         return EINA_TRUE;
+      for (dir = 0; dir < 8; dir += 2)
+      {
+         if (r + dir_row[dir] >= row && r + dir_row[dir] < row + b->area_rows &&
+             c + dir_col[dir] >= col && c + dir_col[dir] < col + b->area_cols)
+            continue;
+         if (!_move_allowed(s, is_walkable, r, c, dir))
+            continue;
+         packed = PACK(s, r + dir_row[dir], c + dir_col[dir]);
+         if (b->seen[packed] == stamp)
+            continue;
+         if (b->seen[packed] >= first)
+            return EINA_TRUE;
+         b->seen[packed] = stamp;
+         s->heap[count++] = packed;
+      }
+   }
+   return EINA_FALSE;
+}
+
+/**
+ * Check if the area with the top-left corner at row,col cut off some start
+ * cell from the goal. Only the start cells hanging below the area in the
+ * flood tree can be cut off: they leave the tree through a cell (the exit)
+ * adiacent to the area, that must find another way.
+ */
+static Eina_Bool
+_blocking_check(Blocking *b, Search *s,
+                Eina_Bool (*is_walkable)(int row, int col),
+                int *area, int row, int col, unsigned int *stamp)
+{
+   int area_count = b->area_rows * b->area_cols;
+   int r, c, nr, nc, i, j, dir, x, cut;
+   unsigned int first = *stamp;
+   Eina_Bool topmost;
+
+   // the tree cells of the area (-1 the ones out of the tree)
+   for (i = 0, r = row; r < row + b->area_rows; r++)
+      for (c = col; c < col + b->area_cols; c++, i++)
+      {
+         area[i] = PACK(s, r, c);
+         if (b->start[area[i]])
+            return EINA_TRUE;
+         if (_search_node(s, area[i])->state != NODE_CLOSED)
+            area[i] = -1;
+      }
+
+   // every exit with start cells below (that do not pass through the area
+   // again) must still reach a cell with an intact way home
+   for (i = 0, r = row; r < row + b->area_rows; r++)
+      for (c = col; c < col + b->area_cols; c++, i++)
+      {
+         if (area[i] < 0) continue;
+         for (dir = 0; dir < 8; dir += 2)
+         {
+            nr = r + dir_row[dir];
+            nc = c + dir_col[dir];
+            if ((nr >= row && nr < row + b->area_rows &&
+                 nc >= col && nc < col + b->area_cols) ||
+                !_blocking_walkable(s, is_walkable, nr, nc))
+               continue;
+            x = PACK(s, nr, nc);
+            if (_search_node(s, x)->state != NODE_CLOSED ||
+                s->nodes[x].parent != area[i])
+               continue;
+
+            // the starts below the exit, less the ones below the area again
+            cut = b->below[x];
+            for (j = 0; j < area_count && cut > 0; j++)
+            {
+               int k, a = area[j];
+
+               if (a < 0 || b->pre[a] <= b->pre[x] ||
+                   b->pre[a] >= b->pre[x] + b->size[x])
+                  continue;
+               topmost = EINA_TRUE;
+               for (k = 0; k < area_count && topmost; k++)
+                  if (k != j && area[k] >= 0 &&
+                      b->pre[area[k]] > b->pre[x] &&
+                      b->pre[area[k]] < b->pre[a] &&
+                      b->pre[a] < b->pre[area[k]] + b->size[area[k]])
+                     topmost = EINA_FALSE;
+               if (topmost)
+                  cut -= b->below[a];
+            }
+            if (cut <= 0)
+               continue;
+
+            // met by a previous flood, that got away from there
+            if (b->seen[x] >= first)
+               continue;
+            if (!_blocking_escape(b, s, is_walkable, area, area_count,
+                                  row, col, x, first, (*stamp)++))
+               return EINA_TRUE;
+         }
+      }
+   return EINA_FALSE;
+}
+
+/**
+ * Rebuild the blocking map.
+ * The diagonal moves can't cut corners, so the cells connected by 8-way
+ * moves are the ones connected by orthogonal moves only: a single orthogonal
+ * flood from the goal give a tree with a way home for every cell.
+ * An area can cut off a start cell only if that start hangs below the area
+ * in the tree, and only if the cells around the area are split in more than
+ * a single run (otherwise the ways through the area can go around it).
+ * Just in these (few) cases a small flood from the cut branch look for
+ * another way home, stopping as soon as it meets an intact branch.
+ */
+static Eina_Bool
+_blocking_build(Blocking *b, int goal_row, int goal_col,
+                Eina_List **starts, int starts_count,
+                Eina_Bool (*is_walkable)(int row, int col))
+{
+   Search *s = &_search;
+   Eina_List *l;
+   Node *n;
+   int head = 0, count, curPacked, packed, row, col, dir, i, r, c;
+   int *area, checks = 0;
+   unsigned int stamp = 1;
+   Eina_Bool all_reached = EINA_TRUE, any_start = EINA_FALSE;
+
+   area = malloc(b->area_rows * b->area_cols * sizeof(int));
+   if (!area || !_search_grid_set(s, b->rows, b->cols))
+   {
+      CRITICAL("Failure to allocate mem for the blocking map");
+      EDE_FREE(area);
+      return EINA_FALSE;
+   }
+
+   // orthogonal flood from the goal, keeping the parents
+   _search_begin(s, is_walkable);
+   if (is_walkable(goal_row, goal_col))
+   {
+      packed = PACK(s, goal_row, goal_col);
+      n = _search_node(s, packed);
+      n->state = NODE_CLOSED;
+      n->parent = packed;
+      s->heap[s->heap_count++] = packed;
+   }
+   while (head < s->heap_count)
+   {
+      curPacked = s->heap[head++];
+      row = UNPACK_ROW(s, curPacked);
+      col = UNPACK_COL(s, curPacked);
+      b->size[curPacked] = 1;
+      b->below[curPacked] = 0;
+      b->seen[curPacked] = 0;
+      for (dir = 0; dir < 8; dir += 2)
+      {
+         if (!_move_allowed(s, is_walkable, row, col, dir))
+            continue;
+         packed = PACK(s, row + dir_row[dir], col + dir_col[dir]);
+         n = _search_node(s, packed);
+         if (n->state == NODE_CLOSED)
+            continue;
+         n->state = NODE_CLOSED;
+         n->parent = curPacked;
+         s->heap[s->heap_count++] = packed;
+      }
+   }
+   count = s->heap_count;
+   s->heap_count = 0;
+
+   // mark the start cells
+   memset(b->start, 0, b->rows * b->cols);
+   for (i = 0; i < starts_count; i++)
+      for (l = starts[i]; l && l->next; l = l->next->next)
+      {
+         row = (int)(long)eina_list_data_get(l);
+         col = (int)(long)eina_list_data_get(l->next);
+         any_start = EINA_TRUE;
+         if (row < 0 || col < 0 || row >= b->rows || col >= b->cols)
+         {
+            all_reached = EINA_FALSE;
+            continue;
+         }
+         packed = PACK(s, row, col);
+         if (_search_node(s, packed)->state != NODE_CLOSED)
+            all_reached = EINA_FALSE;
+         else if (!b->start[packed])
+            b->below[packed] = 1;
+         b->start[packed] = 1;
+      }
+
+   // sizes and starts of the subtrees, leaves first (the reverse of the
+   // flood order), then the preorder of the tree (parents first)
+   for (i = count - 1; i > 0; i--)
+   {
+      packed = s->heap[i];
+      b->size[s->nodes[packed].parent] += b->size[packed];
+      b->below[s->nodes[packed].parent] += b->below[packed];
+   }
+   for (i = 0; i < count; i++)
+   {
+      packed = s->heap[i];
+      if (i == 0)
+         b->pre[packed] = 0;
+      else
+      {
+         // seen[] is the next free index for the children of the parent
+         b->pre[packed] = b->seen[s->nodes[packed].parent];
+         b->seen[s->nodes[packed].parent] += b->size[packed];
+      }
+      b->seen[packed] = b->pre[packed] + 1;
+   }
+   for (i = 0; i < count; i++)
+      b->seen[s->heap[i]] = 0;
+
+   // check every placement
+   for (row = 0; row <= b->rows - b->area_rows; row++)
+      for (col = 0; col <= b->cols - b->area_cols; col++)
+      {
+         b->map[row * b->cols + col] = 0;
+
+         // only placements on walkable cells are checked
+         for (r = row; r < row + b->area_rows; r++)
+            for (c = col; c < col + b->area_cols; c++)
+               if (!is_walkable(r, c))
+                  goto next;
+
+         // if some start is already cut off, everything is blocking
+         if (!all_reached)
+         {
+            b->map[row * b->cols + col] = 1;
+            continue;
+         }
+
+         // no start cells, nothing to cut off
+         if (!any_start)
+            continue;
+
+         // the goal can't be covered
+         if (goal_row >= row && goal_row < row + b->area_rows &&
+             goal_col >= col && goal_col < col + b->area_cols)
+         {
+            b->map[row * b->cols + col] = 1;
+            continue;
+         }
+
+         // a single run of free cells around: all the ways can go around
+         if (_blocking_ring_runs(s, is_walkable, row, col,
+                                 b->area_rows, b->area_cols) <= 1)
+         {
+            // (but not over a start)
+            for (r = row; r < row + b->area_rows; r++)
+               for (c = col; c < col + b->area_cols; c++)
+                  if (b->start[PACK(s, r, c)])
+                     b->map[row * b->cols + col] = 1;
+            continue;
+         }
+
+         checks++;
+         b->map[row * b->cols + col] = _blocking_check(b, s, is_walkable, area,
+                                                       row, col, &stamp);
+next:
+         ;
+      }
+
+   D("Blocking map built, %d placements checked\n", checks);
+   free(area);
+   return EINA_TRUE;
+}
+
+/**
+ * Check if placing an area (a tower) with the top-left corner at row,col
+ * would cut all the ways from some start cell to the goal.
+ * No search is done here: the answer come from a map calculated once for
+ * every grid revision (and area size). Only if the map can't be allocated a
+ * flood check just this placement, the answer is never a wrong 'free'.
+ */
+EAPI Eina_Bool
+ede_pathfinder_placement_blocking_get(int level_rows, int level_cols,
+                                      int goal_row, int goal_col,
+                                      Eina_List **starts, int starts_count,
+                                      int row, int col,
+                                      int area_rows, int area_cols,
+                                      Eina_Bool (*is_walkable)(int row, int col),
+                                      unsigned int revision)
+{
+   Blocking *b = &_blocking;
+   double start_time;
+   int cells = level_rows * level_cols;
+
+   if (row < 0 || col < 0 || row >= level_rows || col >= level_cols)
+      return EINA_FALSE;
+
+   if (!b->valid || b->revision != revision ||
+       b->rows != level_rows || b->cols != level_cols ||
+       b->area_rows != area_rows || b->area_cols != area_cols)
+   {
+      if (!b->map || b->rows != level_rows || b->cols != level_cols)
+      {
+         _blocking_free(b);
+         b->map = calloc(cells, 1);
+         b->pre = malloc(cells * sizeof(int));
+         b->size = malloc(cells * sizeof(int));
+         b->below = malloc(cells * sizeof(int));
+         b->seen = malloc(cells * sizeof(unsigned int));
+         b->start = malloc(cells);
+         if (!b->map || !b->pre || !b->size || !b->below ||
+             !b->seen || !b->start)
+         {
+            CRITICAL("Failure to allocate mem for the blocking map");
+            _blocking_free(b);
+         }
+      }
+      b->rows = level_rows;
+      b->cols = level_cols;
+      b->area_rows = area_rows;
+      b->area_cols = area_cols;
+      b->revision = revision;
+      start_time = ecore_time_get();
+      b->valid = b->map && _blocking_build(b, goal_row, goal_col,
+                                           starts, starts_count, is_walkable);
+      _stats_add(PATHFINDER_QUERY_PLACEMENT, ecore_time_get() - start_time,
+                 0, 0);
+   }
+
+   // no map (out of memory): just check this placement, with a flood
+   if (!b->valid)
+   {
+      _excluded_is_walkable = is_walkable;
+      _excluded_row = row;
+      _excluded_col = col;
+      _excluded_rows = area_rows;
+      _excluded_cols = area_cols;
+      return !_reachable_flood(&_search, level_rows, level_cols,
+                               goal_row, goal_col, starts, starts_count,
+                               _excluded_walkable_get);
+   }
+
+   return b->map[row * level_cols + col];
+}
+
+/**************   FLOW FIELD   ***********************************************/
+/*
+ * The field keep, for every cell, the cost to the goal (dist) and the one
+ * step lookahead of it (rhs = best dist of the neighbours + move cost), as
+ * in LPA*. When only few cells change walkability only the cells made
+ * inconsistent (dist != rhs) by the change are queued and fixed, instead of
+ * rebuilding the whole field.
+ */
+static void
+_field_rhs_update(Search *s, Field *f, int packed)
+{
+   int row, col, dir, adiacentPacked, cost;
+   int best = FIELD_INF, best_dir = DIR_NONE;
+
+   row = UNPACK_ROW(s, packed);
+   col = UNPACK_COL(s, packed);
+   if (!f->is_walkable(row, col))
+      {}
+   else if (packed == f->goal)
+      best = 0;
+   else
+   {
+      for (dir = 0; dir < 8; dir++)
+      {
+         if (!_move_allowed(s, f->is_walkable, row, col, dir))
+            continue;
+         adiacentPacked = PACK(s, row + dir_row[dir], col + dir_col[dir]);
+         if (f->dist[adiacentPacked] >= FIELD_INF)
+            continue;
+         cost = f->dist[adiacentPacked] + DIR_COST(dir);
+         if (cost < best)
+         {
+            best = cost;
+            best_dir = dir;
+         }
+      }
+   }
+   f->rhs[packed] = best;
+   f->dir[packed] = best_dir;
+}
+
+static void
+_field_cell_update(Search *s, Field *f, int packed)
+{
+   Node *n;
+   int key, old_key;
+
+   _field_rhs_update(s, f, packed);
+
+   // keep the cell in the queue only if inconsistent, keyed by min(dist, rhs)
+   n = _search_node(s, packed);
+   key = f->dist[packed] < f->rhs[packed] ? f->dist[packed] : f->rhs[packed];
+   if (n->state == NODE_OPEN)
+   {
+      if (f->dist[packed] == f->rhs[packed])
+         _open_remove(s, n->heap_index);
+      else
+      {
+         old_key = n->g;
+         n->g = key;
+         if (key < old_key)
+            _open_sift_up(s, n->heap_index);
+         else
+            _open_sift_down(s, n->heap_index);
+      }
+   }
+   else if (f->dist[packed] != f->rhs[packed])
+   {
+      n->g = key;
+      n->h = 0;
+      _open_push(s, packed);
+   }
+}
+
+static void
+_field_neighbours_update(Search *s, Field *f, int packed)
+{
+   int row, col, dir;
+
+   // moves are symmetric, so the cells that can use this one as next hop
+   // are all around it
+   row = UNPACK_ROW(s, packed);
+   col = UNPACK_COL(s, packed);
+   for (dir = 0; dir < 8; dir++)
+   {
+      if (row + dir_row[dir] < 0 || row + dir_row[dir] >= s->rows ||
+          col + dir_col[dir] < 0 || col + dir_col[dir] >= s->cols)
+         continue;
+      _field_cell_update(s, f, PACK(s, row + dir_row[dir], col + dir_col[dir]));
+   }
+}
+
+/**
+ * Alloc (if needed) the field tables and fill them with a Dijkstra from the
+ * given (packed) goal over the whole grid.
+ */
+static Eina_Bool
+_field_build(Search *s, Field *f, int level_rows, int level_cols, int goal,
+             Eina_Bool (*is_walkable)(int row, int col))
+{
+   Node *cur, *adiacent;
+   int curPacked, adiacentPacked;
+   int row, col, dir, G;
+
+   // alloc/realloc the field and the search tables if the grid size is changed
+   if (!_search_grid_set(s, level_rows, level_cols))
+      return EINA_FALSE;
+   if (!f->dist || f->rows != level_rows || f->cols != level_cols)
+   {
+      EDE_FREE(f->dist);
+      EDE_FREE(f->rhs);
+      EDE_FREE(f->dir);
+      f->dist = malloc(level_rows * level_cols * sizeof(int));
+      f->rhs = malloc(level_rows * level_cols * sizeof(int));
+      f->dir = malloc(level_rows * level_cols);
+      if (!f->dist || !f->rhs || !f->dir)
+      {
+         CRITICAL("Failure to allocate mem for the flow field");
+         EDE_FREE(f->dist);
+         EDE_FREE(f->rhs);
+         EDE_FREE(f->dir);
+         f->valid = EINA_FALSE;
+         return EINA_FALSE;
+      }
+      f->rows = level_rows;
+      f->cols = level_cols;
+   }
+
+   // start with all the cells unreachable
+   for (row = 0; row < level_rows * level_cols; row++)
+      f->dist[row] = f->rhs[row] = FIELD_INF;
+   memset(f->dir, DIR_NONE, level_rows * level_cols);
+   f->goal = goal;
+   f->is_walkable = is_walkable;
+   f->valid = EINA_TRUE;
+
+   _search_begin(s, f->is_walkable);
+   if (!is_walkable(UNPACK_ROW(s, goal), UNPACK_COL(s, goal)))
+      return EINA_TRUE;
+
+   // Dijkstra from the goal. As moves are symmetric the cost from the goal to
+   // a cell is the same of the cost from that cell to the goal.
+   cur = _search_node(s, f->goal);
+   cur->g = cur->h = 0;
+   cur->parent = f->goal;
+   _open_push(s, f->goal);
+
+   while (s->heap_count > 0)
+   {
+      curPacked = _open_pop(s);
+      s->loops++;
+      cur = &s->nodes[curPacked];
+      f->dist[curPacked] = f->rhs[curPacked] = cur->g;
+
+      row = UNPACK_ROW(s, curPacked);
+      col = UNPACK_COL(s, curPacked);
+      for (dir = 0; dir < 8; dir++)
+      {
+         if (!_move_allowed(s, is_walkable, row, col, dir))
+            continue;
+
+         adiacentPacked = PACK(s, row + dir_row[dir], col + dir_col[dir]);
+         adiacent = _search_node(s, adiacentPacked);
+         if (adiacent->state == NODE_CLOSED)
+            continue;
+
+         G = cur->g + DIR_COST(dir);
+         if (adiacent->state == NODE_NEW || G < adiacent->g)
+         {
+            // the next hop of the adiacent cell is the current one
+            adiacent->g = G;
+            adiacent->parent = curPacked;
+            f->dir[adiacentPacked] = DIR_OPPOSITE(dir);
+            if (adiacent->state == NODE_NEW)
+            {
+               adiacent->h = 0;
+               _open_push(s, adiacentPacked);
+            }
+            else
+               _open_sift_up(s, adiacent->heap_index);
+         }
+      }
+   }
+   return EINA_TRUE;
+}
+
+/**
+ * Fix the field after the walkability of the cells in the given rect has
+ * changed, only the cells affected by the change are touched.
+ */
+static void
+_field_repair(Search *s, Field *f, int row, int col, int rows, int cols)
+{
+   int curPacked, r, c;
+   int first_row, last_row, first_col, last_col;
+
+   // the changed cells, and the diagonal moves that pass on their corners,
+   // can only affect the cells in the rect expanded by one
+   first_row = row > 0 ? row - 1 : 0;
+   first_col = col > 0 ? col - 1 : 0;
+   last_row = row + rows < f->rows ? row + rows : f->rows - 1;
+   last_col = col + cols < f->cols ? col + cols : f->cols - 1;
+   _search_begin(s, f->is_walkable);
+   for (r = first_row; r <= last_row; r++)
+      for (c = first_col; c <= last_col; c++)
+         _field_cell_update(s, f, PACK(s, r, c));
+
+   // fix the inconsistent cells in order, until none remain
+   while (s->heap_count > 0)
+   {
+      curPacked = _open_pop(s);
+      s->loops++;
+      if (f->dist[curPacked] > f->rhs[curPacked])
+      {
+         // the cell got cheaper, fix it and propagate to the neighbours
+         f->dist[curPacked] = f->rhs[curPacked];
+         _field_neighbours_update(s, f, curPacked);
+      }
+      else
+      {
+         // the cell got more expensive, invalidate it and propagate
+         f->dist[curPacked] = FIELD_INF;
+         _field_cell_update(s, f, curPacked);
+         _field_neighbours_update(s, f, curPacked);
+      }
+   }
+   D("Repaired %d cells\n", s->loops);
+}
+
+/**
+ * (Re)build the flow field toward the given goal (the home).
+ * Run a single Dijkstra from the goal over the whole grid, this cost
+ * O(cells) and after that every enemy can find its way just reading the
+ * direction stored in the cell it is on.
+ * When the walkable cells change use ede_pathfinder_flowfield_repair().
+ */
+EAPI Eina_Bool
+ede_pathfinder_flowfield_update(int level_rows, int level_cols,
+                                int goal_row, int goal_col,
+                                Eina_Bool (*is_walkable)(int row, int col))
+{
+   double start_time = ecore_time_get();
+
+   D("Building flow field to %d,%d [map: %d,%d]\n",
+     goal_row, goal_col, level_rows, level_cols);
+
+   if (!_field_build(&_search, &_field, level_rows, level_cols,
+                     goal_row * level_cols + goal_col, is_walkable))
+      return EINA_FALSE;
+   _stats_add(PATHFINDER_QUERY_FIELD, ecore_time_get() - start_time,
+              _search.loops, _search.open_peak);
+
+   _dump_field(&_field, info_to_console, info_in_game);
+
+   return EINA_TRUE;
+}
+
+/**
+ * Repair the flow field after the walkability of the cells in the given
+ * rect has changed (ex: a tower has been placed or sold).
+ * Only the part of the field affected by the change is recalculated.
+ * @return EINA_FALSE if there is no field to repair, the caller must
+ *         build it from scratch with ede_pathfinder_flowfield_update()
+ */
+EAPI Eina_Bool
+ede_pathfinder_flowfield_repair(int row, int col, int rows, int cols)
+{
+   Search *s = &_search;
+   Field *f = &_field;
+   double start_time = ecore_time_get();
+
+   if (!f->valid || !_search_grid_set(s, f->rows, f->cols))
+      return EINA_FALSE;
+
+   D("Repairing flow field at %d,%d [%dx%d]\n", row, col, rows, cols);
+   _field_repair(s, f, row, col, rows, cols);
+   _stats_add(PATHFINDER_QUERY_FIELD, ecore_time_get() - start_time,
+              s->loops, s->open_peak);
+   _dump_field(f, info_to_console, info_in_game);
+
+   return EINA_TRUE;
+}
+
+/**
+ * Get the next hop to follow, from the given cell, to reach the flow field
+ * goal.
+ * @return EINA_FALSE if the goal is not reachable from the cell (or if the
+ *         cell is the goal itself)
+ */
+EAPI Eina_Bool
+ede_pathfinder_flowfield_next(int row, int col, int *next_row, int *next_col)
+{
+   Field *f = &_field;
+   int dir;
+
+   if (!f->valid || row < 0 || col < 0 || row >= f->rows || col >= f->cols)
+      return EINA_FALSE;
+
+   dir = f->dir[row * f->cols + col];
+   if (dir == DIR_NONE)
+      return EINA_FALSE;
+
+   if (next_row) *next_row = row + dir_row[dir];
+   if (next_col) *next_col = col + dir_col[dir];
+   return EINA_TRUE;
+}
+
+/**************   LANDMARKS (ALT)   *****************************************/
+/**
+ * Choose the landmarks and build their cost tables (count is clamped to
+ * LANDMARKS_MAX, 0 turn the heuristic off and free the tables).
+ * The landmarks are picked farthest first: every new one is the cell with
+ * the highest cost to the nearest landmark choosen yet, so they end up on
+ * the outskirts of the level, where the bound is tighter.
+ * When the walkable cells change use ede_pathfinder_landmarks_repair().
+ */
+EAPI Eina_Bool
+ede_pathfinder_landmarks_build(int level_rows, int level_cols, int count,
+                               Eina_Bool (*is_walkable)(int row, int col))
+{
+   Search *s = &_search;
+   Landmarks *lm = &_landmarks;
+   Field *f;
+   int i, cell, best, best_cost, cost, expanded = 0, open_peak = 0;
+   double start_time = ecore_time_get();
+
+   // free the old tables, if any
+   for (i = 0; i < LANDMARKS_MAX; i++)
+   {
+      f = &lm->fields[i];
+      EDE_FREE(f->dist);
+      EDE_FREE(f->rhs);
+      EDE_FREE(f->dir);
+      f->valid = EINA_FALSE;
+   }
+   lm->count = 0;
+   if (count <= 0 || !is_walkable)
+      return EINA_TRUE;
+   if (count > LANDMARKS_MAX)
+      count = LANDMARKS_MAX;
+
+   D("Building %d landmarks [map: %d,%d]\n", count, level_rows, level_cols);
+
+   // the first walkable cell is just a seed, the farthest one from it is
+   // the first landmark
+   for (best = 0; best < level_rows * level_cols; best++)
+      if (is_walkable(best / level_cols, best % level_cols))
+         break;
+   if (best == level_rows * level_cols)
+      return EINA_TRUE;
+   if (!_field_build(s, &lm->fields[0], level_rows, level_cols, best, is_walkable))
+      return EINA_FALSE;
+   for (cell = 0, best_cost = 0; cell < level_rows * level_cols; cell++)
+      if (lm->fields[0].dist[cell] < FIELD_INF &&
+          lm->fields[0].dist[cell] > best_cost)
+      {
+         best_cost = lm->fields[0].dist[cell];
+         best = cell;
+      }
+
+   for (i = 0; i < count; i++)
+   {
+      if (!_field_build(s, &lm->fields[i], level_rows, level_cols, best, is_walkable))
+         return EINA_FALSE;
+      lm->count = i + 1;
+      expanded += s->loops;
+      if (s->open_peak > open_peak)
+         open_peak = s->open_peak;
+
+      // the next one is the farthest from all the landmarks
+      best_cost = 0;
+      for (cell = 0; cell < level_rows * level_cols; cell++)
+      {
+         if (lm->fields[0].dist[cell] >= FIELD_INF)
+            continue;
+         for (cost = FIELD_INF, f = lm->fields; f < lm->fields + lm->count; f++)
+            if (f->dist[cell] < cost)
+               cost = f->dist[cell];
+         if (cost > best_cost)
+         {
+            best_cost = cost;
+            best = cell;
+         }
+      }
+      if (best_cost == 0) // all the reachable cells are landmarks yet
+         break;
+   }
+   _stats_add(PATHFINDER_QUERY_FIELD, ecore_time_get() - start_time,
+              expanded, open_peak);
+   return EINA_TRUE;
+}
+
+/**
+ * Repair the landmarks tables after the walkability of the cells in the
+ * given rect has changed (ex: a tower has been placed or sold).
+ * NOTE: this must be done before the next search: when cells are freed the
+ *       old tables can overestimate and A* would not be optimal anymore.
+ * @return EINA_FALSE if there are no tables to repair
+ */
+EAPI Eina_Bool
+ede_pathfinder_landmarks_repair(int row, int col, int rows, int cols)
+{
+   Search *s = &_search;
+   Landmarks *lm = &_landmarks;
+   int i, expanded = 0, open_peak = 0;
+   double start_time = ecore_time_get();
+
+   if (lm->count == 0 ||
+       !_search_grid_set(s, lm->fields[0].rows, lm->fields[0].cols))
+      return EINA_FALSE;
+
+   D("Repairing %d landmarks at %d,%d [%dx%d]\n", lm->count, row, col, rows, cols);
+   for (i = 0; i < lm->count; i++)
+   {
+      _field_repair(s, &lm->fields[i], row, col, rows, cols);
+      expanded += s->loops;
+      if (s->open_peak > open_peak)
+         open_peak = s->open_peak;
+   }
+   _stats_add(PATHFINDER_QUERY_FIELD, ecore_time_get() - start_time,
+              expanded, open_peak);
+   return EINA_TRUE;
+}
+
+/**************   HIERARCHICAL (HPA*)   **************************************/
+static inline Hpa_Cluster *
+_hpa_cluster_at(Hpa *h, int row, int col)
+{
+   return &h->clusters[(row / HPA_CLUSTER_SIZE) * h->ccols + col / HPA_CLUSTER_SIZE];
+}
+
+static int
+_hpa_node_index(Hpa_Cluster *c, int packed)
+{
+   int i;
+
+   for (i = 0; i < c->count; i++)
+      if (c->cells[i] == packed)
+         return i;
+   return -1;
+}
+
+static void
+_hpa_node_add(Hpa *h, Hpa_Cluster *c, int row, int col)
+{
+   int packed = PACK(h, row, col);
+
+   if (c->count < HPA_MAX_NODES && _hpa_node_index(c, packed) < 0)
+      c->cells[c->count++] = packed;
+}
+
+/**
+ * Scan one border of the cluster and add the entrance cells on the cluster
+ * side. The border start at row,col and go on in the drow,dcol direction,
+ * orow,ocol is the offset of the cell on the other side.
+ * Every maximal run of cells open on both sides is an entrance: short ones
+ * get a cell in the middle, long ones a cell at each end. The neighbour
+ * cluster do the same scan, so entrance cells always come in pairs.
+ */
+static void
+_hpa_border_scan(Hpa *h, Hpa_Cluster *c, int row, int col,
+                 int drow, int dcol, int orow, int ocol, int len)
+{
+   int i, start = -1;
+   Eina_Bool open;
+
+   for (i = 0; i <= len; i++)
+   {
+      open = i < len &&
+             h->is_walkable(row + i * drow, col + i * dcol) &&
+             h->is_walkable(row + i * drow + orow, col + i * dcol + ocol);
+      if (open && start < 0)
+         start = i;
+      else if (!open && start >= 0)
+      {
+         // the run is start..i-1
+         if (i - start < 6)
+            _hpa_node_add(h, c, row + (start + i - 1) / 2 * drow,
+                                col + (start + i - 1) / 2 * dcol);
+         else
+         {
+            _hpa_node_add(h, c, row + start * drow, col + start * dcol);
+            _hpa_node_add(h, c, row + (i - 1) * drow, col + (i - 1) * dcol);
+         }
+         start = -1;
+      }
+   }
+}
+
+/**
+ * Dijkstra from the given cell, without leaving the cluster.
+ * Put in costs the cost to reach each one of the count cells in 'to'.
+ */
+static void
+_hpa_local_costs(Hpa *h, Hpa_Cluster *c, int from,
+                 const int *to, int count, int *costs)
+{
+   Search *s = &_search;
+   int curPacked, row, col, nrow, ncol, dir, i;
+   Node *n;
+
+   _search_begin(s, h->is_walkable);
+   if (h->is_walkable(UNPACK_ROW(s, from), UNPACK_COL(s, from)))
+   {
+      n = _search_node(s, from);
+      n->g = n->h = 0;
+      n->parent = from;
+      _open_push(s, from);
+   }
+
+   while (s->heap_count > 0)
+   {
+      curPacked = _open_pop(s);
+      row = UNPACK_ROW(s, curPacked);
+      col = UNPACK_COL(s, curPacked);
+      for (dir = 0; dir < 8; dir++)
+      {
+         nrow = row + dir_row[dir];
+         ncol = col + dir_col[dir];
+         if (nrow < c->row || nrow >= c->row + c->rows ||
+             ncol < c->col || ncol >= c->col + c->cols ||
+             !_move_allowed(s, h->is_walkable, row, col, dir))
+            continue;
+         // using the cell itself as target give H = 0, a plain Dijkstra
+         _open_relax(s, curPacked, PACK(s, nrow, ncol),
+                     s->nodes[curPacked].g + DIR_COST(dir), nrow, ncol);
+      }
+   }
+
+   for (i = 0; i < count; i++)
+   {
+      n = &s->nodes[to[i]];
+      costs[i] = (n->gen == s->gen && n->state == NODE_CLOSED) ? n->g : HPA_INF;
+   }
+}
+
+/**
+ * Find the entrances of the cluster and calc the costs between them.
+ */
+static Eina_Bool
+_hpa_cluster_build(Hpa *h, Hpa_Cluster *c)
+{
+   int i;
+
+   c->count = 0;
+   if (c->row > 0) // top
+      _hpa_border_scan(h, c, c->row, c->col, 0, 1, -1, 0, c->cols);
+   if (c->row + c->rows < h->rows) // bottom
+      _hpa_border_scan(h, c, c->row + c->rows - 1, c->col, 0, 1, 1, 0, c->cols);
+   if (c->col > 0) // left
+      _hpa_border_scan(h, c, c->row, c->col, 1, 0, 0, -1, c->rows);
+   if (c->col + c->cols < h->cols) // right
+      _hpa_border_scan(h, c, c->row, c->col + c->cols - 1, 1, 0, 0, 1, c->rows);
+
+   EDE_FREE(c->costs);
+   if (c->count == 0)
+      return EINA_TRUE;
+   c->costs = malloc(c->count * c->count * sizeof(int));
+   if (!c->costs)
+   {
+      CRITICAL("Failure to allocate mem for the HPA* cluster");
+      c->count = 0;
+      return EINA_FALSE;
+   }
+   for (i = 0; i < c->count; i++)
+      _hpa_local_costs(h, c, c->cells[i], c->cells, c->count,
+                       c->costs + i * c->count);
+   return EINA_TRUE;
+}
+
+/**
+ * Build the hierarchical graph of the whole grid.
+ * When the walkable cells change use ede_pathfinder_hpa_repair().
+ */
+EAPI Eina_Bool
+ede_pathfinder_hpa_build(int level_rows, int level_cols,
+                         Eina_Bool (*is_walkable)(int row, int col))
+{
+   Hpa *h = &_hpa;
+   Hpa_Cluster *c;
+   int r, col;
+
+   D("Building HPA* graph [map: %d,%d]\n", level_rows, level_cols);
+
+   _hpa_free(h);
+   if (!_search_grid_set(&_search, level_rows, level_cols))
+      return EINA_FALSE;
+
+   h->rows = level_rows;
+   h->cols = level_cols;
+   h->crows = (level_rows + HPA_CLUSTER_SIZE - 1) / HPA_CLUSTER_SIZE;
+   h->ccols = (level_cols + HPA_CLUSTER_SIZE - 1) / HPA_CLUSTER_SIZE;
+   h->is_walkable = is_walkable;
+   h->clusters = calloc(h->crows * h->ccols, sizeof(Hpa_Cluster));
+   if (!h->clusters)
+   {
+      CRITICAL("Failure to allocate mem for the HPA* clusters");
+      return EINA_FALSE;
+   }
+
+   for (r = 0; r < h->crows; r++)
+      for (col = 0; col < h->ccols; col++)
+      {
+         c = &h->clusters[r * h->ccols + col];
+         c->row = r * HPA_CLUSTER_SIZE;
+         c->col = col * HPA_CLUSTER_SIZE;
+         c->rows = level_rows - c->row < HPA_CLUSTER_SIZE ?
+                   level_rows - c->row : HPA_CLUSTER_SIZE;
+         c->cols = level_cols - c->col < HPA_CLUSTER_SIZE ?
+                   level_cols - c->col : HPA_CLUSTER_SIZE;
+         if (!_hpa_cluster_build(h, c))
+         {
+            _hpa_free(h);
+            return EINA_FALSE;
+         }
+      }
+
+   h->valid = EINA_TRUE;
+   return EINA_TRUE;
+}
+
+/**
+ * Update the hierarchical graph after the walkability of the cells in the
+ * given rect has changed. Only the clusters touched by the rect are rebuilt
+ * (and the neighbours sharing a touched border, as their entrances change).
+ * @return EINA_FALSE if there is no graph to repair, the caller must build it
+ *         from scratch with ede_pathfinder_hpa_build()
+ */
+EAPI Eina_Bool
+ede_pathfinder_hpa_repair(int row, int col, int rows, int cols)
+{
+   Hpa *h = &_hpa;
+   Hpa_Cluster *c;
+   int r, cl, first_r, last_r, first_c, last_c;
+
+   if (!h->valid || !_search_grid_set(&_search, h->rows, h->cols))
+      return EINA_FALSE;
+
+   D("Repairing HPA* graph at %d,%d [%dx%d]\n", row, col, rows, cols);
+
+   first_r = row / HPA_CLUSTER_SIZE;
+   last_r = (row + rows - 1) / HPA_CLUSTER_SIZE;
+   first_c = col / HPA_CLUSTER_SIZE;
+   last_c = (col + cols - 1) / HPA_CLUSTER_SIZE;
+   for (r = first_r; r <= last_r; r++)
+      for (cl = first_c; cl <= last_c; cl++)
+      {
+         c = &h->clusters[r * h->ccols + cl];
+         if (!_hpa_cluster_build(h, c))
+            return EINA_FALSE;
+
+         // the neighbours, if the rect touch the border shared with them
+         if (r == first_r && r > 0 && row == c->row)
+            _hpa_cluster_build(h, c - h->ccols);
+         if (r == last_r && r < h->crows - 1 && row + rows == c->row + c->rows)
+            _hpa_cluster_build(h, c + h->ccols);
+         if (cl == first_c && cl > 0 && col == c->col)
+            _hpa_cluster_build(h, c - 1);
+         if (cl == last_c && cl < h->ccols - 1 && col + cols == c->col + c->cols)
+            _hpa_cluster_build(h, c + 1);
+      }
+   return EINA_TRUE;
+}
+
+/**
+ * Find the route from start to goal on the hierarchical graph.
+ * The route is made of the entrance cells to pass through (and the goal as
+ * the last one), the legs between them must be refined with a local search.
+ * @return the abstract route, NULL if unreachable or if the graph is not built
+ */
+EAPI Ede_Path *
+ede_pathfinder_hpa_route(int start_row, int start_col, int goal_row, int goal_col)
+{
+   Hpa *h = &_hpa;
+   Search *s = &_search;
+   Hpa_Cluster *sc, *gc, *c, *oc;
+   Ede_Path *path = NULL;
+   Node *cur;
+   int start_costs[HPA_MAX_NODES + 1], goal_costs[HPA_MAX_NODES];
+   int to[HPA_MAX_NODES + 1];
+   int startPacked, goalPacked, curPacked, otherPacked;
+   int row, col, dir, i, j, count, loops = 0;
+   double start_time = ecore_time_get();
+
+   if (!h->valid || !_search_grid_set(s, h->rows, h->cols))
+      return NULL;
+   if (!h->is_walkable(start_row, start_col) || !h->is_walkable(goal_row, goal_col))
+      return NULL;
+
+   startPacked = PACK(s, start_row, start_col);
+   goalPacked = PACK(s, goal_row, goal_col);
+   sc = _hpa_cluster_at(h, start_row, start_col);
+   gc = _hpa_cluster_at(h, goal_row, goal_col);
+
+   // connect start and goal to the entrances of their clusters (and start
+   // directly to goal if they share the cluster)
+   memcpy(to, sc->cells, sc->count * sizeof(int));
+   to[sc->count] = goalPacked;
+   _hpa_local_costs(h, sc, startPacked, to, sc->count + 1, start_costs);
+   _hpa_local_costs(h, gc, goalPacked, gc->cells, gc->count, goal_costs);
+   if (sc != gc) start_costs[sc->count] = HPA_INF;
+
+   // A* on the entrance cells, using the same nodes table of the grid search
+   _search_begin(s, h->is_walkable);
+   cur = _search_node(s, startPacked);
+   cur->g = 0;
+   cur->h = HEURISTIC(start_row, start_col, goal_row, goal_col);
+   cur->parent = startPacked;
+   _open_push(s, startPacked);
+
+   while (s->heap_count > 0)
+   {
+      curPacked = _open_pop(s);
+      loops++;
+      if (curPacked == goalPacked)
+         break;
+
+      cur = &s->nodes[curPacked];
+      row = UNPACK_ROW(s, curPacked);
+      col = UNPACK_COL(s, curPacked);
+      c = _hpa_cluster_at(h, row, col);
+
+      if (curPacked == startPacked)
+         for (j = 0; j <= sc->count; j++)
+            if (start_costs[j] < HPA_INF)
+               _open_relax(s, curPacked, to[j], start_costs[j], goal_row, goal_col);
+
+      i = _hpa_node_index(c, curPacked);
+      if (i < 0) continue;
+
+      // inside the cluster, to the other entrances (and to the goal)
+      for (j = 0; j < c->count; j++)
+         if (j != i && c->costs[i * c->count + j] < HPA_INF)
+            _open_relax(s, curPacked, c->cells[j],
+                        cur->g + c->costs[i * c->count + j], goal_row, goal_col);
+      if (c == gc && goal_costs[i] < HPA_INF)
+         _open_relax(s, curPacked, goalPacked, cur->g + goal_costs[i],
+                     goal_row, goal_col);
+
+      // across the borders, to the entrances of the neighbour clusters
+      for (dir = 0; dir < 8; dir += 2)
+      {
+         if (!_move_allowed(s, h->is_walkable, row, col, dir))
+            continue;
+         oc = _hpa_cluster_at(h, row + dir_row[dir], col + dir_col[dir]);
+         otherPacked = PACK(s, row + dir_row[dir], col + dir_col[dir]);
+         if (oc != c && _hpa_node_index(oc, otherPacked) >= 0)
+            _open_relax(s, curPacked, otherPacked, cur->g + DIR_COST(dir),
+                        goal_row, goal_col);
+      }
+   }
+
+   D("HPA* route %d,%d -> %d,%d: %s [%d loops]\n", start_row, start_col,
+     goal_row, goal_col, curPacked == goalPacked ? "found" : "unreachable", loops);
+   _stats.mode_expanded[PATHFINDER_HPA] += loops;
+   _stats.searches[PATHFINDER_HPA]++;
+   _stats_add(PATHFINDER_QUERY_PATH, ecore_time_get() - start_time,
+              loops, s->open_peak);
+   if (s->nodes[goalPacked].gen != s->gen ||
+       s->nodes[goalPacked].state != NODE_CLOSED)
+      return NULL;
+
+   // the route is made of the cells on the parents chain, start excluded
+   count = 0;
+   for (curPacked = goalPacked; curPacked != startPacked;
+        curPacked = s->nodes[curPacked].parent)
+      count++;
+   path = _path_alloc(count);
+   if (!path) return NULL;
+   for (curPacked = goalPacked; curPacked != startPacked;
+        curPacked = s->nodes[curPacked].parent)
+      path->hops[--count] = EDE_PATH_HOP_PACK(UNPACK_ROW(s, curPacked),
+                                              UNPACK_COL(s, curPacked));
+   path->mode = PATHFINDER_HPA;
+   return path;
+}
+
+/**************   PATH CACHE   ***********************************************/
+/**
+ * Search the cache (and the precomputed routes) for the path from start to
+ * goal.
+ * @return a new reference to the cached path, NULL if not in the cache
+ */
+static Ede_Path *
+_cache_lookup(int start_row, int start_col, int goal_row, int goal_col,
+              Ede_Pathfinder_Mode mode, unsigned int revision)
+{
+   Eina_List *l;
+   Ede_Path *path;
+
+   EINA_LIST_FOREACH(_routes, l, path)
+      if (path->revision == revision && path->mode == mode &&
+          path->start_row == start_row && path->start_col == start_col &&
+          path->goal_row == goal_row && path->goal_col == goal_col)
+      {
+         _stats.cache_hits++;
+         return ede_pathfinder_path_ref(path);
+      }
+
+   path = _cache[CACHE_SLOT(start_row, start_col, goal_row, goal_col, mode)];
+   if (path && path->revision == revision && path->mode == mode &&
+       path->start_row == start_row && path->start_col == start_col &&
+       path->goal_row == goal_row && path->goal_col == goal_col)
+   {
+      _stats.cache_hits++;
+      return ede_pathfinder_path_ref(path);
+   }
+   return NULL;
+}
+
+/**
+ * Put a just calculated path in the cache (replacing the one in the slot).
+ * @param path the path, or NULL if the goal is unreachable
+ * @return the path to give to the caller (marked unreachable, with no hops,
+ *         if the goal is unreachable) or NULL on memory error
+ */
+static Ede_Path *
+_cache_store(Ede_Path *path, int start_row, int start_col,
+             int goal_row, int goal_col,
+             Ede_Pathfinder_Mode mode, unsigned int revision)
+{
+   unsigned int slot;
+
+   if (!path)
+   {
+      // unreachable, cache it as empty
+      path = _path_alloc(0);
+      if (!path) return NULL;
+      path->unreachable = EINA_TRUE;
+   }
+   path->start_row = start_row;
+   path->start_col = start_col;
+   path->goal_row = goal_row;
+   path->goal_col = goal_col;
+   path->revision = revision;
+   path->mode = mode;
+
+   slot = CACHE_SLOT(start_row, start_col, goal_row, goal_col, mode);
+   if (_cache[slot]) ede_pathfinder_path_unref(_cache[slot]);
+   _cache[slot] = ede_pathfinder_path_ref(path);
+
+   return path;
+}
+
+/**
+ * Get the path from start to goal, from the cache if a path has already been
+ * calculated on the same grid revision, otherwise running the A* search.
+ * The returned path is shared and must not be changed, release it with
+ * ede_pathfinder_path_unref() when done.
+ * @return the path (marked unreachable if the goal is unreachable) or NULL on
+ *         memory error
+ */
+EAPI Ede_Path *
+ede_pathfinder_path_get(int level_rows, int level_cols,
+                        int start_row, int start_col,
+                        int goal_row, int goal_col,
+                        Eina_Bool (*is_walkable)(int row, int col),
+                        Ede_Pathfinder_Mode mode,
+                        unsigned int revision)
+{
+   Ede_Path *path;
+
+   path = _cache_lookup(start_row, start_col, goal_row, goal_col, mode, revision);
+   if (path)
+      return path;
+
+   // cache miss, calc a new path and put it in the slot
+   _stats.cache_misses++;
+   if (mode == PATHFINDER_HPA)
+      path = ede_pathfinder_hpa_route(start_row, start_col, goal_row, goal_col);
+   else
+      path = ede_pathfinder(level_rows, level_cols, start_row, start_col,
+                            goal_row, goal_col, is_walkable, mode, 0, EINA_FALSE);
+   return _cache_store(path, start_row, start_col, goal_row, goal_col,
+                       mode, revision);
+}
+
+/**
+ * Create a new path (not cached) from the given packed hops.
+ */
+EAPI Ede_Path *
+ede_pathfinder_path_new(const int *hops, int count)
+{
+   Ede_Path *path;
+
+   path = _path_alloc(count);
+   if (path && count > 0)
+      memcpy(path->hops, hops, count * sizeof(int));
+   return path;
+}
+
+EAPI Ede_Path *
+ede_pathfinder_path_ref(Ede_Path *path)
+{
+   path->refcount++;
+   return path;
+}
+
+EAPI void
+ede_pathfinder_path_unref(Ede_Path *path)
+{
+   if (--path->refcount > 0)
+      return;
+   EDE_FREE(path);
+}
+
+/**
+ * Find the cell on the path, walking the segments between the hops (the
+ * hops of a smoothed path can be far apart) as the enemies do.
+ * @return the index of the next hop to follow from the cell, -1 if the
+ *         cell is not on the path (or the path is unreachable)
+ */
+EAPI int
+ede_pathfinder_path_hop_find(const Ede_Path *path, int row, int col)
+{
+   Line l;
+   int i, hop_row, hop_col;
+
+   if (path->unreachable)
+      return -1;
+   if (row == path->start_row && col == path->start_col)
+      return 0;
+
+   _line_begin(&l, path->start_row, path->start_col,
+               path->start_row, path->start_col);
+   for (i = 0; i < path->count; i++)
+   {
+      hop_row = EDE_PATH_HOP_ROW(path->hops[i]);
+      hop_col = EDE_PATH_HOP_COL(path->hops[i]);
+      _line_begin(&l, l.row, l.col, hop_row, hop_col);
+      while (_line_step(&l) != LINE_END)
+         if (l.row == row && l.col == col)
+            return (row == hop_row && col == hop_col) ? i + 1 : i;
+   }
+   return -1;
+}
+
+/**
+ * Check if an enemy can walk straight from the center of a cell to the center
+ * of the other one, with the same rules of the smoothed paths.
+ */
+EAPI Eina_Bool
+ede_pathfinder_line_walkable(int row, int col, int to_row, int to_col,
+                             Eina_Bool (*is_walkable)(int row, int col))
+{
+   Search s;
+
+   s.map = NULL; // only the callback is used
+   return _line_of_sight(&s, is_walkable, row, col, to_row, to_col);
+}
+
+/**
+ * Drop all the paths in the cache (the ones in use are kept alive by the
+ * users references).
+ */
+EAPI void
+ede_pathfinder_cache_clear(void)
+{
+   int i;
+
+   for (i = 0; i < PATH_CACHE_SIZE; i++)
+      if (_cache[i])
+      {
+         ede_pathfinder_path_unref(_cache[i]);
+         _cache[i] = NULL;
+      }
+}
+
+/**************   WALKABLE MAP   *********************************************/
+/**
+ * Create a new walkability bitmap for a grid of the given size, with all
+ * the cells (and the border) unwalkable.
+ */
+EAPI Ede_Walkable_Map *
+ede_pathfinder_walkable_map_new(int rows, int cols)
+{
+   Ede_Walkable_Map *map;
+   int stride;
+
+   // one spare word at the end of every row, see _map_bits3()
+   stride = (cols + 2 + 31) / 32 + 1;
+   map = calloc(1, sizeof(Ede_Walkable_Map) +
+                   (rows + 2) * stride * sizeof(unsigned int));
+   if (!map)
+   {
+      CRITICAL("Failure to allocate mem for the walkable map");
+      return NULL;
+   }
+   map->rows = rows;
+   map->cols = cols;
+   map->stride = stride;
+   return map;
+}
+
+EAPI void
+ede_pathfinder_walkable_map_free(Ede_Walkable_Map *map)
+{
+   if (map == _map)
+      _map = NULL;
+   free(map);
+}
+
+EAPI void
+ede_pathfinder_walkable_map_set(Ede_Walkable_Map *map, int row, int col,
+                                Eina_Bool walkable)
+{
+   unsigned int *w;
+
+   w = map->bits + (row + 1) * map->stride + ((col + 1) >> 5);
+   if (walkable)
+      *w |= 1u << ((col + 1) & 31);
+   else
+      *w &= ~(1u << ((col + 1) & 31));
+}
+
+/**
+ * Tell the pathfinder that the given bitmap is always up to date with the
+ * given walkability function, so the searches using the function can read
+ * the bitmap instead. NULL to stop using it.
+ */
+EAPI void
+ede_pathfinder_walkable_map_use(const Ede_Walkable_Map *map,
+                                Eina_Bool (*is_walkable)(int row, int col))
+{
+   _map = map;
+   _map_is_walkable = map ? is_walkable : NULL;
+}
+
+/**************   PATH JOBS   ************************************************/
+/**
+ * Get a snapshot of the grid walkability, taken only once per revision.
+ * @return a new reference to the snapshot, NULL on memory error
+ */
+static Snapshot *
+_snapshot_get(int rows, int cols, Eina_Bool (*is_walkable)(int row, int col),
+              unsigned int revision)
+{
+   Snapshot *snap = _snapshot;
+   int row, col;
+
+   if (snap && snap->revision == revision && snap->is_walkable == is_walkable &&
+       snap->map->rows == rows && snap->map->cols == cols)
+   {
+      snap->refcount++;
+      return snap;
+   }
+
+   snap = EDE_NEW(Snapshot);
+   if (snap) snap->map = ede_pathfinder_walkable_map_new(rows, cols);
+   if (!snap || !snap->map)
+   {
+      CRITICAL("Failure to allocate mem for the grid snapshot");
+      EDE_FREE(snap);
+      return NULL;
+   }
+   snap->refcount = 2; // one for the caller, one for _snapshot
+   snap->revision = revision;
+   snap->is_walkable = is_walkable;
+
+   // just a copy of the bitmap kept by the grid owner, if there is one
+   if (_map && is_walkable == _map_is_walkable &&
+       _map->rows == rows && _map->cols == cols)
+      memcpy(snap->map->bits, _map->bits,
+             (rows + 2) * _map->stride * sizeof(unsigned int));
+   else
+      for (row = 0; row < rows; row++)
+         for (col = 0; col < cols; col++)
+            ede_pathfinder_walkable_map_set(snap->map, row, col,
+                                            is_walkable(row, col));
+
+   if (_snapshot) _snapshot_unref(_snapshot);
+   _snapshot = snap;
+   return snap;
+}
+
+/**
+ * Call the job callback and free the job (already out of the queue).
+ */
+static void
+_job_done(Ede_Path_Job *job, Ede_Path *path)
+{
+   _stats_add(PATHFINDER_QUERY_JOB, ecore_time_get() - job->added,
+              job->loops, job->open_peak);
+   if (job == _job_running)
+      _job_running = NULL;
+   if (job->done_cb)
+      job->done_cb(job->data, job, path);
+   if (path) ede_pathfinder_path_unref(path);
+   EDE_FREE(job);
+}
+
+/**
+ * Put the result of a job in the cache, see _cache_store(). If the smoothing
+ * has been switched since the job was requested the path is only given to
+ * the caller, the cache is for the other kind now.
+ */
+static Ede_Path *
+_job_result_store(Ede_Path_Job *job, Ede_Path *path)
+{
+   unsigned int slot;
+
+   path = _cache_store(path, job->start_row, job->start_col,
+                       job->goal_row, job->goal_col, job->mode, job->revision);
+   slot = CACHE_SLOT(job->start_row, job->start_col,
+                     job->goal_row, job->goal_col, job->mode);
+   if (path && job->smooth != _smooth && _cache[slot] == path)
+   {
+      ede_pathfinder_path_unref(path);
+      _cache[slot] = NULL;
+   }
+   return path;
+}
+
+/**
+ * Try to complete the job without searching: the path can be in the cache
+ * yet, and HPA* routes are cheap enough to just calculate them now.
+ * @return EINA_TRUE if the job is done (and freed)
+ */
+static Eina_Bool
+_job_quick_run(Ede_Path_Job *job)
+{
+   Ede_Path *path;
+
+   path = _cache_lookup(job->start_row, job->start_col,
+                        job->goal_row, job->goal_col,
+                        job->mode, job->revision);
+   if (!path && job->mode == PATHFINDER_HPA)
+      path = ede_pathfinder_path_get(job->rows, job->cols,
+                                     job->start_row, job->start_col,
+                                     job->goal_row, job->goal_col,
+                                     job->is_walkable, job->mode,
+                                     job->revision);
+   if (!path)
+      return EINA_FALSE;
+
+   _jobs = eina_list_remove(_jobs, job);
+   _job_done(job, path);
+   return EINA_TRUE;
+}
+
+/**
+ * The job is not in a worker anymore, it is not a twin of the others now.
+ */
+static void
+_job_in_workers_del(Ede_Path_Job *job)
+{
+   // (the workers can end after the shutdown)
+   if (_jobs_in_workers && eina_hash_find(_jobs_in_workers, job) == job)
+      eina_hash_del_by_key(_jobs_in_workers, job);
+}
+
+/**
+ * Get the next job to run, not yet given to a worker.
+ * @param skip_twins also skip the jobs with the same request of a job in a
+ *        worker, they will get the path from the cache when it is done
+ */
+static Ede_Path_Job *
+_job_next_get(Eina_Bool skip_twins)
+{
+   Ede_Path_Job *job;
+   Eina_List *l;
+
+   EINA_LIST_FOREACH(_jobs, l, job)
+   {
+      if (job->thread)
+         continue;
+      if (!skip_twins || !_jobs_threads ||
+          !eina_hash_find(_jobs_in_workers, job))
+         return job;
+   }
+   return NULL;
+}
+
+static void
+_search_local_free(void *data)
+{
+   Search *s = data;
+
+   _search_free(s);
+   free(s);
+}
+
+/**
+ * Run the whole search of a job, in a worker thread. Every worker has its
+ * own scratch memory, and only read the grid snapshot of the job.
+ */
+static void
+_job_thread_run(void *data, Ecore_Thread *thread)
+{
+   Ede_Path_Job *job = data;
+   Search *s;
+
+   job->state = ST_SEARCHING; // not finished, if leaving early
+   s = ecore_thread_local_data_find(thread, "ede_search");
+   if (!s)
+   {
+      s = EDE_NEW(Search);
+      if (!s) return;
+      if (!ecore_thread_local_data_add(thread, "ede_search", s,
+                                       _search_local_free, EINA_FALSE))
+      {
+         free(s);
+         return;
+      }
+   }
+   if (!_search_grid_set(s, job->rows, job->cols))
+      return;
+
+   s->map = job->snapshot->map;
+   if (!_astar_begin(s, job->start_row, job->start_col,
+                     job->goal_row, job->goal_col, NULL, job->mode,
+                     job->queue, job->smooth))
+   {
+      job->state = ST_TARGET_UNREACHABLE;
+      return;
+   }
+   do
+   {
+      // stop early if the job has been canceled
+      if (ecore_thread_check(thread))
+         return;
+      job->state = _astar_run(s, PATH_JOBS_SLICE);
+   } while (job->state == ST_SEARCHING);
+   job->loops = s->loops;
+   job->open_peak = s->open_peak;
+
+   if (job->state == ST_TARGET_FOUND)
+      job->path = _astar_path_build(s);
+}
+
+/**
+ * The worker finished the job, merge the result back (in the main loop).
+ */
+static void
+_job_thread_end(void *data, Ecore_Thread *thread EINA_UNUSED)
+{
+   Ede_Path_Job *job = data;
+   Ede_Path *path;
+
+   _jobs_threads--;
+   _job_in_workers_del(job);
+   _snapshot_unref(job->snapshot);
+   if (job->canceled)
+   {
+      if (job->path) ede_pathfinder_path_unref(job->path);
+      EDE_FREE(job);
+      return;
+   }
+
+   // only cache real results, not memory errors
+   _jobs = eina_list_remove(_jobs, job);
+   if (job->state == ST_SEARCHING ||
+       (job->state == ST_TARGET_FOUND && !job->path))
+      path = NULL;
+   else
+      path = _job_result_store(job, job->path);
+   _job_done(job, path);
+}
+
+static void
+_job_thread_cancel(void *data, Ecore_Thread *thread EINA_UNUSED)
+{
+   Ede_Path_Job *job = data;
+
+   _jobs_threads--;
+   _job_in_workers_del(job);
+   _snapshot_unref(job->snapshot);
+   job->snapshot = NULL;
+   if (job->path) ede_pathfinder_path_unref(job->path);
+   job->path = NULL;
+   if (job->canceled)
+   {
+      EDE_FREE(job);
+      return;
+   }
+
+   // the worker can't be started, run the jobs in the main loop from now on
+   WRN("Cannot start a pathfinder worker, using the main loop only");
+   job->thread = NULL;
+   _workers = 0;
+}
+
+/**
+ * Give the job to a worker thread.
+ * @return EINA_FALSE if the job must be run in the main loop
+ */
+static Eina_Bool
+_job_thread_start(Ede_Path_Job *job)
+{
+   Ecore_Thread *thread;
+
+   job->snapshot = _snapshot_get(job->rows, job->cols, job->is_walkable,
+                                 job->revision);
+   if (!job->snapshot)
+      return EINA_FALSE;
+
+   _jobs_threads++;
+   _stats.cache_misses++;
+   // NOTE: without threads support ecore call the callbacks (that can free
+   // the job) before returning NULL, so mark the job as given to a worker
+   // first, and don't touch it if NULL is returned
+   job->thread = (Ecore_Thread *)job;
+   eina_hash_direct_add(_jobs_in_workers, job, job);
+   thread = ecore_thread_run(_job_thread_run, _job_thread_end,
+                             _job_thread_cancel, job);
+   if (thread) job->thread = thread;
+   return EINA_TRUE;
+}
+
+/**
+ * Request a path that will be calculated in the background: by the worker
+ * threads if available, otherwise in the next frames, as the time budget
+ * given to ede_pathfinder_jobs_run() permit.
+ * @param done_cb called (in the main loop) when the path is ready, the path
+ *        given to the callback (marked unreachable if the goal is
+ *        unreachable, NULL on memory error) is only valid inside the callback, take a
+ *        reference to keep it
+ * @return the job handle, valid until the callback is called or the job is
+ *         canceled. NULL on error.
+ */
+EAPI Ede_Path_Job *
+ede_pathfinder_job_add(int level_rows, int level_cols,
+                       int start_row, int start_col,
+                       int goal_row, int goal_col,
+                       Eina_Bool (*is_walkable)(int row, int col),
+                       Ede_Pathfinder_Mode mode,
+                       unsigned int revision,
+                       Ede_Path_Job_Cb done_cb, void *data)
+{
+   Ede_Path_Job *job;
+
+   job = EDE_NEW(Ede_Path_Job);
+   if (!job)
+   {
+      CRITICAL("Failure to allocate mem for a path job");
+      return NULL;
+   }
+   job->rows = level_rows;
+   job->cols = level_cols;
+   job->start_row = start_row;
+   job->start_col = start_col;
+   job->goal_row = goal_row;
+   job->goal_col = goal_col;
+   job->is_walkable = is_walkable;
+   job->mode = mode;
+   job->revision = revision;
+   job->queue = _queue;
+   job->smooth = _smooth;
+   job->done_cb = done_cb;
+   job->data = data;
+   job->added = ecore_time_get();
+   _jobs = eina_list_append(_jobs, job);
+   return job;
+}
+
+/**
+ * Remove a pending job, the callback will not be called.
+ */
+EAPI void
+ede_pathfinder_job_cancel(Ede_Path_Job *job)
+{
+   _jobs = eina_list_remove(_jobs, job);
+   if (job == _job_running)
+      _job_running = NULL;
+
+   // the worker is still using it, will be freed when the worker ends
+   if (job->thread)
+   {
+      _job_in_workers_del(job);
+      job->canceled = EINA_TRUE;
+      if (job->thread != (Ecore_Thread *)job)
+         ecore_thread_cancel(job->thread);
+      return;
+   }
+   EDE_FREE(job);
+}
+
+/**
+ * Set the time that ede_pathfinder_jobs_run() can use every frame, when
+ * running the jobs in the main loop.
+ */
+EAPI void
+ede_pathfinder_jobs_budget_set(int usec)
+{
+   _jobs_budget = usec > 0 ? usec : PATH_JOBS_BUDGET;
+}
+
+/**
+ * Set the max number of jobs given to the worker threads at once,
+ * 0 to run all the jobs in the main loop.
+ */
+EAPI void
+ede_pathfinder_jobs_workers_set(int count)
+{
+   _workers = count > 0 ? count : 0;
+}
+
+/**
+ * Run the pending jobs. With the workers available the jobs are just given
+ * to them (the results are merged back by the main loop), otherwise the
+ * jobs are run here until all are done or the time budget is exhausted:
+ * a search not finished in time is suspended, and resumed on the next call.
+ * To be called once per frame.
+ * @return the number of jobs still pending
+ */
+EAPI int
+ede_pathfinder_jobs_run(void)
+{
+   Search *s = &_job_search;
+   Ede_Path_Job *job;
+   Ede_Path *path;
+   double end;
+   int state;
+
+   if (!_jobs) return 0;
+
+   // fan out the jobs to the workers
+   while (_workers > 0 && _jobs_threads < _workers &&
+          (job = _job_next_get(EINA_TRUE)))
+   {
+      if (_job_quick_run(job))
+         continue;
+      if (!_job_thread_start(job))
+         break;
+   }
+   if (_workers > 0)
+      return eina_list_count(_jobs);
+
+   // no workers, run the jobs here
+   end = ecore_time_get() + _jobs_budget / 1000000.0;
+   while ((job = _job_next_get(EINA_FALSE)))
+   {
+      if (job != _job_running)
+      {
+         if (_job_quick_run(job))
+            continue;
+         if (!_search_grid_set(s, job->rows, job->cols))
+            break;
+         _stats.cache_misses++;
+         _job_running = job;
+         state = _astar_begin(s, job->start_row, job->start_col,
+                              job->goal_row, job->goal_col,
+                              job->is_walkable, job->mode,
+                              job->queue, job->smooth) ?
+                 ST_SEARCHING : ST_TARGET_UNREACHABLE;
+      }
+      else
+         state = ST_SEARCHING;
+
+      // continue the search, a slice at a time, until the budget allow
+      if (state == ST_SEARCHING)
+      {
+         state = _astar_run(s, PATH_JOBS_SLICE);
+         if (state == ST_SEARCHING)
+         {
+            if (ecore_time_get() >= end) break;
+            continue;
+         }
+      }
+
+      // job done, the callback can add new jobs
+      job->loops = s->loops;
+      job->open_peak = s->open_peak;
+      _jobs = eina_list_remove(_jobs, job);
+      path = state == ST_TARGET_FOUND ? _astar_path_build(s) : NULL;
+      // only cache real results, not memory errors
+      if (state == ST_TARGET_FOUND && !path)
+         _job_done(job, NULL);
+      else
+         _job_done(job, _job_result_store(job, path));
+
+      if (ecore_time_get() >= end) break;
+   }
+
+   return eina_list_count(_jobs);
+}
+
+/**************   PRECOMPUTED ROUTES   ***************************************/
+static void
+_route_job_done_cb(void *data EINA_UNUSED, Ede_Path_Job *job, Ede_Path *path)
+{
+   _routes_jobs = eina_list_remove(_routes_jobs, job);
+   if (path)
+      _routes = eina_list_append(_routes, ede_pathfinder_path_ref(path));
+}
+
+/**
+ * Check if the route from the given start cell is known, or coming.
+ */
+static Eina_Bool
+_route_exists(int start_row, int start_col)
+{
+   Eina_List *l;
+   Ede_Path_Job *job;
+   Ede_Path *path;
+
+   EINA_LIST_FOREACH(_routes, l, path)
+      if (path->start_row == start_row && path->start_col == start_col)
+         return EINA_TRUE;
+   EINA_LIST_FOREACH(_routes_jobs, l, job)
+      if (job->start_row == start_row && job->start_col == start_col)
+         return EINA_TRUE;
+   return EINA_FALSE;
+}
+
+/**
+ * Calculate in advance the paths from all the start cells to the goal, so
+ * that ede_pathfinder_path_get() (and the jobs) find them ready, without
+ * searching when the enemies are spawned. The routes are kept until the next
+ * update (the cache can instead drop them when the slot is needed).
+ * Call this when the level is loaded and after every grid change.
+ * @param starts array of lists of start cells (row, col, row, col, ...)
+ * @param starts_count number of lists in the array
+ * @param wait calculate the routes now, otherwise in the next frames by
+ *        the path jobs
+ * NOTE: the flow field and the HPA* modes do not need precomputed routes
+ */
+EAPI void
+ede_pathfinder_routes_update(int level_rows, int level_cols,
+                             int goal_row, int goal_col,
+                             Eina_List **starts, int starts_count,
+                             Eina_Bool (*is_walkable)(int row, int col),
+                             Ede_Pathfinder_Mode mode,
+                             unsigned int revision, Eina_Bool wait)
+{
+   Ede_Path_Job *job;
+   Ede_Path *path;
+   Eina_List *l;
+   int row, col, i;
+
+   // the old routes are calculated on an old grid
+   ede_pathfinder_routes_clear();
+   if (mode == PATHFINDER_FLOWFIELD || mode == PATHFINDER_HPA)
+      return;
+
+   for (i = 0; i < starts_count; i++)
+      for (l = starts[i]; l && l->next; l = l->next->next)
+      {
+         row = (int)(long)eina_list_data_get(l);
+         col = (int)(long)eina_list_data_get(l->next);
+         if (_route_exists(row, col))
+            continue;
+         if (wait)
+         {
+            path = ede_pathfinder_path_get(level_rows, level_cols, row, col,
+                                           goal_row, goal_col, is_walkable,
+                                           mode, revision);
+            if (path)
+               _routes = eina_list_append(_routes, path);
+            continue;
+         }
+         job = ede_pathfinder_job_add(level_rows, level_cols, row, col,
+                                      goal_row, goal_col, is_walkable,
+                                      mode, revision, _route_job_done_cb, NULL);
+         if (job)
+            _routes_jobs = eina_list_append(_routes_jobs, job);
+      }
+   D("Routes: %d ready, %d pending\n",
+     eina_list_count(_routes), eina_list_count(_routes_jobs));
+}
+
+/**
+ * Drop all the precomputed routes (and the jobs calculating them).
+ */
+EAPI void
+ede_pathfinder_routes_clear(void)
+{
+   Ede_Path_Job *job;
+   Ede_Path *path;
+
+   EINA_LIST_FREE(_routes_jobs, job)
+      ede_pathfinder_job_cancel(job);
+   EINA_LIST_FREE(_routes, path)
+      ede_pathfinder_path_unref(path);
+}
+
+/**
+ * Copy the statistics collected since the start (or the last reset).
+ */
+EAPI void
+ede_pathfinder_stats_get(Ede_Pathfinder_Stats *stats)
+{
+   if (stats) memcpy(stats, &_stats, sizeof(_stats));
+}
+
+EAPI void
+ede_pathfinder_stats_reset(void)
+{
+   memset(&_stats, 0, sizeof(_stats));
+}
+
+EAPI const char *
+ede_pathfinder_query_name_get(Ede_Pathfinder_Query query)
+{
+   if (query < 0 || query >= PATHFINDER_QUERY_COUNT)
+      return "unknown";
+   return query_names[query];
+}
+
+EAPI void
+ede_pathfinder_debug_info_fill(Eina_Strbuf *t)
+{
+   eina_strbuf_append(t, "<h3>pathfinder:</h3><br>");
+   eina_strbuf_append_printf(t, "jobs pending %d  in workers %d/%d<br>",
+                             eina_list_count(_jobs), _jobs_threads, _workers);
+   eina_strbuf_append_printf(t, "routes %d  pending %d<br>",
+                             eina_list_count(_routes), eina_list_count(_routes_jobs));
+   if (_landmarks.count)
+      eina_strbuf_append_printf(t, "landmarks %d<br>", _landmarks.count);
+   eina_strbuf_append(t, "<br>");
+}
+
+EAPI const char *
+ede_pathfinder_mode_name_get(Ede_Pathfinder_Mode mode)
+{
+   if (mode < 0 || mode >= PATHFINDER_MODE_COUNT)
+      return "unknown";
+   return mode_names[mode];
+}
+
+EAPI Eina_Bool
+ede_pathfinder_mode_get_by_name(const char *name, Ede_Pathfinder_Mode *mode)
+{
+   int i;
+
+   for (i = 0; i < PATHFINDER_MODE_COUNT; i++)
+      if (streql(name, mode_names[i]))
+      {
+         *mode = i;
+         return EINA_TRUE;
+      }
+   return EINA_FALSE;
+}
+
+/**
+ * Choose the open list used by the A* (and JPS) searches. Both give paths
+ * of the same cost, the bucket queue has O(1) push and pop.
+ */
+EAPI void
+ede_pathfinder_queue_set(Ede_Pathfinder_Queue queue)
+{
+   _queue = queue;
+}
+
+/**
+ * Turn on (or off) the smoothing of the paths found: the hops that can be
+ * skipped going straight are dropped, so the paths are made of few segments
+ * at any angle, not only the 8 directions of the grid.
+ * NOTE: the HPA* routes are not smoothed, but the legs between them are
+ */
+EAPI void
+ede_pathfinder_smoothing_set(Eina_Bool smooth)
+{
+   if (_smooth == !!smooth) return;
+   _smooth = !!smooth;
+   // the cached paths are of the other kind
+   ede_pathfinder_cache_clear();
+   ede_pathfinder_routes_clear();
 }
 
 EAPI void
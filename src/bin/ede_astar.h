@@ -22,17 +22,176 @@
 #define EDE_ASTAR_H
 
 
+/* how the walking enemies find their way to the home */
+typedef enum {
+   PATHFINDER_ASTAR,     // every enemy run its own A* search
+   PATHFINDER_FLOWFIELD, // all the enemies follow a shared flow field
+   PATHFINDER_JPS,       // as ASTAR, using Jump Point Search
+   PATHFINDER_HPA,       // hierarchical routes, refined while walking
+   PATHFINDER_BIDIR,     // as ASTAR, searching from both the ends (the
+                         // path jobs still run a plain A*)
+   PATHFINDER_MODE_COUNT
+} Ede_Pathfinder_Mode;
+
+/* the open list used by the A* searches */
+typedef enum {
+   PATHFINDER_QUEUE_HEAP,    // binary heap, O(log n) push and pop
+   PATHFINDER_QUEUE_BUCKETS  // circular bucket queue (Dial), O(1) push and pop
+} Ede_Pathfinder_Queue;
+
+/* kind of requests, for the statistics */
+typedef enum {
+   PATHFINDER_QUERY_PATH,      // ede_pathfinder(), the path to follow
+   PATHFINDER_QUERY_CHECK,     // ede_pathfinder(), just check if reachable
+   PATHFINDER_QUERY_JOB,       // path job, from the request to the result
+   PATHFINDER_QUERY_FIELD,     // flow field (or landmarks) build and repair
+   PATHFINDER_QUERY_REACHABLE, // ede_pathfinder_reachable_check()
+   PATHFINDER_QUERY_PLACEMENT, // placement blocking map build
+   PATHFINDER_QUERY_COUNT
+} Ede_Pathfinder_Query;
+
+/* latency buckets: <16us, <64us, <256us, <1ms, <4ms, <16ms, <64ms, more */
+#define EDE_PATHFINDER_LATENCY_BUCKETS 8
+
+/* aggregated pathfinder statistics, always collected */
+typedef struct _Ede_Pathfinder_Stats Ede_Pathfinder_Stats;
+struct _Ede_Pathfinder_Stats
+{
+   unsigned int calls[PATHFINDER_QUERY_COUNT];
+   unsigned long long expanded[PATHFINDER_QUERY_COUNT]; // cells expanded
+   unsigned int latency[PATHFINDER_QUERY_COUNT][EDE_PATHFINDER_LATENCY_BUCKETS];
+   unsigned int searches[PATHFINDER_MODE_COUNT]; // ede_pathfinder() by mode
+   unsigned long long mode_expanded[PATHFINDER_MODE_COUNT]; // ...cells expanded
+   int open_peak; // max cells in an open list at once
+   unsigned int cache_hits, cache_misses;
+};
+
+/* a path shared between all the users, must be considered read only */
+typedef struct _Ede_Path Ede_Path;
+struct _Ede_Path
+{
+   int refcount;
+   int start_row, start_col, goal_row, goal_col; // cache key
+   unsigned int revision;                        // cache key
+   Ede_Pathfinder_Mode mode;                     // cache key
+   Eina_Bool unreachable; // no way from start to goal (no hops), not
+                          // to be taken for an empty path (start == goal)
+   int count;  // number of hops
+   int hops[]; // packed hops to follow (start cell excluded), allocated inline
+};
+#define EDE_PATH_HOP_PACK(_ROW_, _COL_) (((_ROW_) << 16) | (_COL_))
+#define EDE_PATH_HOP_ROW(_HOP_) ((_HOP_) >> 16)
+#define EDE_PATH_HOP_COL(_HOP_) ((_HOP_) & 0xFFFF)
+
+/* Bit-packed walkability of a grid, with a border of walls (one cell wide)
+ * all around, so the neighbours of any cell can be read without bounds
+ * checks. Kept up to date by the owner of the grid, on every cell change. */
+typedef struct _Ede_Walkable_Map Ede_Walkable_Map;
+struct _Ede_Walkable_Map
+{
+   int rows, cols;       // size of the grid (border excluded)
+   int stride;           // words in a row (border and a spare word included)
+   unsigned int bits[];  // (rows + 2) * stride words, the bit set if walkable
+};
+#define EDE_WALKABLE_MAP_GET(_MAP_,_ROW_,_COL_) \
+   (((_MAP_)->bits[((_ROW_) + 1) * (_MAP_)->stride + (((_COL_) + 1) >> 5)] >> \
+     (((_COL_) + 1) & 31)) & 1)
+
+/* a path request calculated in the background, a bit every frame */
+typedef struct _Ede_Path_Job Ede_Path_Job;
+typedef void (*Ede_Path_Job_Cb)(void *data, Ede_Path_Job *job, Ede_Path *path);
+
 EAPI Eina_Bool ede_pathfinder_init(void);
 EAPI Eina_Bool ede_pathfinder_shutdown(void);
 
 EAPI void ede_pathfinder_info_set(Eina_Bool to_console, Eina_Bool in_game);
+EAPI void ede_pathfinder_queue_set(Ede_Pathfinder_Queue queue);
+EAPI void ede_pathfinder_smoothing_set(Eina_Bool smooth);
+EAPI const char *ede_pathfinder_mode_name_get(Ede_Pathfinder_Mode mode);
+EAPI Eina_Bool ede_pathfinder_mode_get_by_name(const char *name, Ede_Pathfinder_Mode *mode);
+
+EAPI Ede_Walkable_Map *ede_pathfinder_walkable_map_new(int rows, int cols);
+EAPI void ede_pathfinder_walkable_map_free(Ede_Walkable_Map *map);
+EAPI void ede_pathfinder_walkable_map_set(Ede_Walkable_Map *map, int row, int col,
+                                          Eina_Bool walkable);
+EAPI void ede_pathfinder_walkable_map_use(const Ede_Walkable_Map *map,
+                                          Eina_Bool (*is_walkable)(int row, int col));
+
+EAPI Ede_Path *ede_pathfinder(int level_rows, int level_cols,
+                              int start_row, int start_col,
+                              int target_row, int target_col,
+                              Eina_Bool (*is_walkable)(int row, int col),
+                              Ede_Pathfinder_Mode mode,
+                              int max_loops, Eina_Bool just_check);
+
+EAPI Eina_Bool ede_pathfinder_reachable_check(int level_rows, int level_cols,
+                                              int goal_row, int goal_col,
+                                              Eina_List **starts, int starts_count,
+                                              Eina_Bool (*is_walkable)(int row, int col));
+
+EAPI Eina_Bool ede_pathfinder_placement_blocking_get(int level_rows, int level_cols,
+                                                     int goal_row, int goal_col,
+                                                     Eina_List **starts, int starts_count,
+                                                     int row, int col,
+                                                     int area_rows, int area_cols,
+                                                     Eina_Bool (*is_walkable)(int row, int col),
+                                                     unsigned int revision);
+
+EAPI Eina_Bool ede_pathfinder_flowfield_update(int level_rows, int level_cols,
+                                               int goal_row, int goal_col,
+                                               Eina_Bool (*is_walkable)(int row, int col));
+EAPI Eina_Bool ede_pathfinder_flowfield_repair(int row, int col, int rows, int cols);
+EAPI Eina_Bool ede_pathfinder_flowfield_next(int row, int col,
+                                             int *next_row, int *next_col);
+
+
+EAPI Eina_Bool ede_pathfinder_landmarks_build(int level_rows, int level_cols, int count,
+                                              Eina_Bool (*is_walkable)(int row, int col));
+EAPI Eina_Bool ede_pathfinder_landmarks_repair(int row, int col, int rows, int cols);
+
+EAPI Eina_Bool ede_pathfinder_hpa_build(int level_rows, int level_cols,
+                                         Eina_Bool (*is_walkable)(int row, int col));
+EAPI Eina_Bool ede_pathfinder_hpa_repair(int row, int col, int rows, int cols);
+EAPI Ede_Path *ede_pathfinder_hpa_route(int start_row, int start_col,
+                                        int goal_row, int goal_col);
+
+EAPI Ede_Path *ede_pathfinder_path_get(int level_rows, int level_cols,
+                                       int start_row, int start_col,
+                                       int goal_row, int goal_col,
+                                       Eina_Bool (*is_walkable)(int row, int col),
+                                       Ede_Pathfinder_Mode mode,
+                                       unsigned int revision);
+EAPI Ede_Path *ede_pathfinder_path_new(const int *hops, int count);
+EAPI Ede_Path *ede_pathfinder_path_ref(Ede_Path *path);
+EAPI void      ede_pathfinder_path_unref(Ede_Path *path);
+EAPI int       ede_pathfinder_path_hop_find(const Ede_Path *path, int row, int col);
+EAPI Eina_Bool ede_pathfinder_line_walkable(int row, int col, int to_row, int to_col,
+                                            Eina_Bool (*is_walkable)(int row, int col));
+EAPI void      ede_pathfinder_cache_clear(void);
 
-EAPI Eina_List *ede_pathfinder(int level_rows, int level_cols,
-                               int start_row, int start_col,
-                               int target_row, int target_col,
-                               Eina_Bool (*is_walkable)(int row, int col),
-                               int max_loops, Eina_Bool just_check);
+EAPI void ede_pathfinder_routes_update(int level_rows, int level_cols,
+                                       int goal_row, int goal_col,
+                                       Eina_List **starts, int starts_count,
+                                       Eina_Bool (*is_walkable)(int row, int col),
+                                       Ede_Pathfinder_Mode mode,
+                                       unsigned int revision, Eina_Bool wait);
+EAPI void ede_pathfinder_routes_clear(void);
 
+EAPI Ede_Path_Job *ede_pathfinder_job_add(int level_rows, int level_cols,
+                                          int start_row, int start_col,
+                                          int goal_row, int goal_col,
+                                          Eina_Bool (*is_walkable)(int row, int col),
+                                          Ede_Pathfinder_Mode mode,
+                                          unsigned int revision,
+                                          Ede_Path_Job_Cb done_cb, void *data);
+EAPI void ede_pathfinder_job_cancel(Ede_Path_Job *job);
+EAPI int  ede_pathfinder_jobs_run(void);
+EAPI void ede_pathfinder_jobs_budget_set(int usec);
+EAPI void ede_pathfinder_jobs_workers_set(int count);
 
+EAPI void      ede_pathfinder_stats_get(Ede_Pathfinder_Stats *stats);
+EAPI void      ede_pathfinder_stats_reset(void);
+EAPI const char *ede_pathfinder_query_name_get(Ede_Pathfinder_Query query);
+EAPI void      ede_pathfinder_debug_info_fill(Eina_Strbuf *t);
 
 #endif /* EDE_ASTAR_H */
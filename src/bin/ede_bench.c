@@ -0,0 +1,701 @@
+/*
+ *  Ede - EFL Defender Environment
+ *  Copyright (C) 2010-2014 Davide Andreoli <dave@gurumeditation.it>
+ *
+ *  This file is part of Ede.
+ *
+ *  Ede is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Ede is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Ede.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Pathfinder micro benchmark (no Evas/Edje needed), 'make check' runs it on
+ * the small maps only, 'make bench' up to 1024x1024.
+ *
+ * Run every pathfinder mode on the same queries and print, for each one, the
+ * cells expanded, the time and the allocations per query. Without arguments
+ * random mazes and open fields of growing size are used, otherwise the given
+ * .level files (the queries go from the start bases to the home). The exit
+ * status is 1 if the modes don't agree: the ones that find the shortest paths
+ * must give the cost of astar on every query (when not smoothing), the
+ * others must answer the same number of queries.
+ *
+ *   ede_bench [-n queries] [-m max size] [-r seed] [-b] [-s] [file.level ...]
+ *
+ * The allocations are counted wrapping malloc/calloc/realloc at link time,
+ * so only the ones made by the pathfinder itself are seen (not the Eina
+ * lists and mempools).
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <Eina.h>
+#include <Ecore.h>
+
+#include "ede.h"
+#include "ede_gui.h"
+#include "ede_astar.h"
+
+
+#define BENCH_QUERIES 20   // default queries for every map
+#define BENCH_MAX_SIZE 128  // default biggest side, keep 'make check' short
+#define BENCH_LANDMARKS 8
+
+/* a way to answer a query, a pathfinder mode with its setup */
+typedef struct _Engine Engine;
+struct _Engine
+{
+   const char *name;
+   Ede_Pathfinder_Mode mode;
+   int landmarks;        // ALT tables to build before the queries
+   Eina_Bool exact;      // always the shortest paths, as astar
+};
+
+/* the grid the queries run on */
+typedef struct _Map Map;
+struct _Map
+{
+   char name[PATH_MAX];
+   int rows, cols;
+   unsigned char *cells;          // 1 if walkable
+   int *queries;                  // start row, col, goal row, col
+   int queries_count;
+};
+
+static const Engine engines[] = {
+   { "astar",     PATHFINDER_ASTAR,     0,               EINA_TRUE },
+   { "astar+alt", PATHFINDER_ASTAR,     BENCH_LANDMARKS, EINA_TRUE },
+   { "jps",       PATHFINDER_JPS,       0,               EINA_TRUE },
+   { "bidir",     PATHFINDER_BIDIR,     0,               EINA_TRUE },
+   { "hpa",       PATHFINDER_HPA,       0,               EINA_FALSE },
+   { "flowfield", PATHFINDER_FLOWFIELD, 0,               EINA_TRUE },
+};
+
+/* generated maps: cols x rows (as the level Size=) */
+static const int sizes[][2] = {
+   { 24, 20 }, { 64, 64 }, { 128, 128 }, { 256, 256 }, { 512, 512 },
+   { 1024, 1024 },
+};
+
+/* Local subsystem vars */
+static Map *_map; // the one in use by _walkable_get()
+static unsigned int _seed = 1;
+static unsigned long _allocs;
+static Eina_Bool _smooth; // the paths are smoothed, their costs can't be compared
+
+int ede_log_domain;
+
+
+/* allocations counters, see the link flags in Makefile.am */
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *
+__wrap_malloc(size_t size)
+{
+   _allocs++;
+   return __real_malloc(size);
+}
+
+void *
+__wrap_calloc(size_t nmemb, size_t size)
+{
+   _allocs++;
+   return __real_calloc(nmemb, size);
+}
+
+void *
+__wrap_realloc(void *ptr, size_t size)
+{
+   _allocs++;
+   return __real_realloc(ptr, size);
+}
+
+/* the pathfinder draw its lists in game only if asked to, never here */
+EAPI void
+ede_gui_cell_overlay_add(Ede_Cell_Overlay overlay, int row, int col)
+{
+}
+
+EAPI void
+ede_gui_cell_overlay_text_set(int row, int col, int val, int pos)
+{
+}
+
+
+/* Local subsystem functions */
+static int
+_rand(int max)
+{
+   // xorshift, to get the same maps everywhere from the same seed
+   _seed ^= _seed << 13;
+   _seed ^= _seed >> 17;
+   _seed ^= _seed << 5;
+   return _seed % max;
+}
+
+static Eina_Bool
+_walkable_get(int row, int col)
+{
+   if (row < 0 || col < 0 || row >= _map->rows || col >= _map->cols)
+      return EINA_FALSE;
+   return _map->cells[row * _map->cols + col];
+}
+
+static Map *
+_map_new(int rows, int cols)
+{
+   Map *map;
+
+   map = EDE_NEW(Map);
+   if (!map) return NULL;
+   map->rows = rows;
+   map->cols = cols;
+   map->cells = calloc(rows * cols, 1);
+   if (!map->cells)
+   {
+      EDE_FREE(map);
+      return NULL;
+   }
+   return map;
+}
+
+static void
+_map_free(Map *map)
+{
+   EDE_FREE(map->cells);
+   EDE_FREE(map->queries);
+   EDE_FREE(map);
+}
+
+/**
+ * Pick count random queries between walkable cells (the first query is
+ * always from corner to corner, the worst case for most of the modes).
+ */
+static Eina_Bool
+_map_queries_random(Map *map, int count)
+{
+   int i, j, cell, first, last;
+
+   map->queries = malloc(count * 4 * sizeof(int));
+   if (!map->queries) return EINA_FALSE;
+
+   for (first = 0; first < map->rows * map->cols && !map->cells[first]; first++);
+   for (last = map->rows * map->cols - 1; last > first && !map->cells[last]; last--);
+   if (first == last) return EINA_FALSE;
+
+   map->queries[0] = first / map->cols;
+   map->queries[1] = first % map->cols;
+   map->queries[2] = last / map->cols;
+   map->queries[3] = last % map->cols;
+   for (i = 1; i < count; i++)
+      for (j = 0; j < 4; j += 2)
+      {
+         do cell = _rand(map->rows * map->cols);
+         while (!map->cells[cell]);
+         map->queries[i * 4 + j] = cell / map->cols;
+         map->queries[i * 4 + j + 1] = cell % map->cols;
+      }
+   map->queries_count = count;
+   return EINA_TRUE;
+}
+
+/**
+ * Random maze, carved with a depth first visit: corridors one cell wide, a
+ * single way between any two cells.
+ */
+static Map *
+_map_maze_new(int rows, int cols, int queries)
+{
+   static const int dr[4] = { -2, 0, 2, 0 };
+   static const int dc[4] = { 0, 2, 0, -2 };
+   Map *map;
+   int *stack, count = 0, cur, r, c, dir, i, n;
+   int next[4];
+
+   map = _map_new(rows, cols);
+   if (!map) return NULL;
+   snprintf(map->name, sizeof(map->name), "maze %dx%d", cols, rows);
+   stack = malloc(rows * cols * sizeof(int));
+   if (!stack)
+   {
+      _map_free(map);
+      return NULL;
+   }
+
+   // the cells on odd rows and cols are the rooms, the others the walls
+   map->cells[1 * cols + 1] = 1;
+   stack[count++] = 1 * cols + 1;
+   while (count > 0)
+   {
+      cur = stack[count - 1];
+      r = cur / cols;
+      c = cur % cols;
+      for (n = 0, dir = 0; dir < 4; dir++)
+         if (r + dr[dir] > 0 && r + dr[dir] < rows - 1 &&
+             c + dc[dir] > 0 && c + dc[dir] < cols - 1 &&
+             !map->cells[(r + dr[dir]) * cols + c + dc[dir]])
+            next[n++] = dir;
+      if (n == 0)
+      {
+         count--;
+         continue;
+      }
+      i = next[_rand(n)];
+      map->cells[(r + dr[i] / 2) * cols + c + dc[i] / 2] = 1;
+      map->cells[(r + dr[i]) * cols + c + dc[i]] = 1;
+      stack[count++] = (r + dr[i]) * cols + c + dc[i];
+   }
+   free(stack);
+
+   if (!_map_queries_random(map, queries))
+   {
+      _map_free(map);
+      return NULL;
+   }
+   return map;
+}
+
+/**
+ * Open field, with short random walls here and there (about 15% of the
+ * cells).
+ */
+static Map *
+_map_field_new(int rows, int cols, int queries)
+{
+   Map *map;
+   int i, r, c, len, walls;
+
+   map = _map_new(rows, cols);
+   if (!map) return NULL;
+   snprintf(map->name, sizeof(map->name), "field %dx%d", cols, rows);
+   memset(map->cells, 1, rows * cols);
+
+   walls = rows * cols * 15 / 100;
+   while (walls > 0)
+   {
+      r = _rand(rows);
+      c = _rand(cols);
+      len = 1 + _rand(8);
+      for (i = 0; i < len && walls > 0; i++, walls--)
+      {
+         map->cells[r * cols + c] = 0;
+         if (len & 1) r = r + 1 < rows ? r + 1 : r;
+         else         c = c + 1 < cols ? c + 1 : c;
+      }
+   }
+
+   if (!_map_queries_random(map, queries))
+   {
+      _map_free(map);
+      return NULL;
+   }
+   return map;
+}
+
+/**
+ * Load the grid of a .level file, the queries go from every start base cell
+ * to the home (repeated up to the wanted count), or random if the level
+ * has no home.
+ */
+static Map *
+_map_level_load(const char *file, int queries)
+{
+   char line[PATH_MAX];
+   Map *map = NULL;
+   FILE *fp;
+   int rows = 0, cols = 0, row = -1, col, home = -1, starts_count = 0, i;
+   int *starts = NULL;
+
+   fp = fopen(file, "r");
+   if (!fp)
+   {
+      ERR("Cannot open level: %s", file);
+      return NULL;
+   }
+
+   while (fgets(line, sizeof(line), fp) != NULL)
+   {
+      if (row < 0)
+      {
+         // the header, just the size is needed
+         if (sscanf(line, "Size=%dx%d", &cols, &rows) == 2)
+            continue;
+         if (strncmp(line, "DATA", 4) != 0)
+            continue;
+         if (rows < 1 || cols < 1)
+            break;
+         map = _map_new(rows, cols);
+         starts = malloc(rows * cols * sizeof(int));
+         if (!map || !starts)
+            break;
+         snprintf(map->name, sizeof(map->name), "%s", file);
+         row = 0;
+         continue;
+      }
+      if (row >= rows)
+         break;
+
+      // walls are the only unwalkable cells at the start
+      for (col = 0; col < cols && line[col] && line[col] != '\n'; col++)
+      {
+         map->cells[row * cols + col] = line[col] != '#';
+         if (line[col] == '@')
+            home = row * cols + col;
+         else if (line[col] >= '0' && line[col] <= '9')
+            starts[starts_count++] = row * cols + col;
+      }
+      row++;
+   }
+   fclose(fp);
+
+   if (!map || row != rows)
+   {
+      ERR("Error parsing level: %s", file);
+      if (map) _map_free(map);
+      free(starts);
+      return NULL;
+   }
+
+   if (home < 0 || starts_count == 0)
+   {
+      free(starts);
+      if (_map_queries_random(map, queries))
+         return map;
+      _map_free(map);
+      return NULL;
+   }
+
+   map->queries = malloc(queries * 4 * sizeof(int));
+   if (!map->queries)
+   {
+      free(starts);
+      _map_free(map);
+      return NULL;
+   }
+   for (i = 0; i < queries; i++)
+   {
+      map->queries[i * 4] = starts[i % starts_count] / cols;
+      map->queries[i * 4 + 1] = starts[i % starts_count] % cols;
+      map->queries[i * 4 + 2] = home / cols;
+      map->queries[i * 4 + 3] = home % cols;
+   }
+   map->queries_count = queries;
+   free(starts);
+   return map;
+}
+
+/**
+ * Cost of the hops of the path, from the given start cell: 10 for a straight
+ * step, 14 for a diagonal one, as the pathfinder count them.
+ */
+static int
+_path_cost(const Ede_Path *path, int row, int col)
+{
+   int cost = 0, dr, dc, i;
+
+   for (i = 0; i < path->count; i++)
+   {
+      dr = abs(EDE_PATH_HOP_ROW(path->hops[i]) - row);
+      dc = abs(EDE_PATH_HOP_COL(path->hops[i]) - col);
+      cost += dr < dc ? 14 * dr + 10 * (dc - dr) : 14 * dc + 10 * (dr - dc);
+      row = EDE_PATH_HOP_ROW(path->hops[i]);
+      col = EDE_PATH_HOP_COL(path->hops[i]);
+   }
+   return cost;
+}
+
+/**
+ * Answer a query the way the enemies would do with the given engine.
+ * @return the cost of the path found, -1 if unreachable
+ */
+static int
+_query(const Engine *engine, int sr, int sc, int gr, int gc)
+{
+   Ede_Path *path, *leg;
+   int cost = -1, r, c, nr, nc, i;
+
+   switch (engine->mode)
+   {
+      case PATHFINDER_HPA:
+         // the abstract route, with all the legs refined
+         path = ede_pathfinder_hpa_route(sr, sc, gr, gc);
+         if (!path) break;
+         for (cost = 0, r = sr, c = sc, i = 0; i < path->count; i++)
+         {
+            nr = EDE_PATH_HOP_ROW(path->hops[i]);
+            nc = EDE_PATH_HOP_COL(path->hops[i]);
+            leg = ede_pathfinder(_map->rows, _map->cols, r, c, nr, nc,
+                                 _walkable_get, PATHFINDER_ASTAR, 0, EINA_FALSE);
+            if (!leg)
+            {
+               cost = -1;
+               break;
+            }
+            cost += _path_cost(leg, r, c);
+            ede_pathfinder_path_unref(leg);
+            r = nr;
+            c = nc;
+         }
+         ede_pathfinder_path_unref(path);
+         break;
+
+      case PATHFINDER_FLOWFIELD:
+         // the field toward the goal, then follow it
+         if (!ede_pathfinder_flowfield_update(_map->rows, _map->cols, gr, gc,
+                                              _walkable_get))
+            break;
+         for (cost = 0, r = sr, c = sc; r != gr || c != gc; r = nr, c = nc)
+         {
+            if (!ede_pathfinder_flowfield_next(r, c, &nr, &nc))
+            {
+               cost = -1;
+               break;
+            }
+            cost += (r != nr && c != nc) ? 14 : 10;
+         }
+         break;
+
+      default:
+         path = ede_pathfinder(_map->rows, _map->cols, sr, sc, gr, gc,
+                               _walkable_get, engine->mode, 0, EINA_FALSE);
+         if (!path) break;
+         cost = _path_cost(path, sr, sc);
+         ede_pathfinder_path_unref(path);
+         break;
+   }
+   return cost;
+}
+
+/**
+ * Run all the queries of the map with the given engine and print a line of
+ * results. The cost of every query (-1 if unreachable) is put in costs.
+ * @return the queries answered with a path
+ */
+static int
+_engine_run(Map *map, const Engine *engine, int *costs)
+{
+   Ede_Pathfinder_Stats st;
+   unsigned long long expanded = 0;
+   unsigned long allocs;
+   double start_time, setup, elapsed;
+   int i, q, found = 0;
+
+   // the shared tables are built once, before the queries
+   start_time = ecore_time_get();
+   if (engine->landmarks)
+      ede_pathfinder_landmarks_build(map->rows, map->cols, engine->landmarks,
+                                     _walkable_get);
+   if (engine->mode == PATHFINDER_HPA)
+      ede_pathfinder_hpa_build(map->rows, map->cols, _walkable_get);
+   setup = ecore_time_get() - start_time;
+
+   ede_pathfinder_stats_reset();
+   allocs = _allocs;
+   start_time = ecore_time_get();
+   for (i = 0; i < map->queries_count; i++)
+   {
+      costs[i] = _query(engine, map->queries[i * 4], map->queries[i * 4 + 1],
+                        map->queries[i * 4 + 2], map->queries[i * 4 + 3]);
+      if (costs[i] >= 0) found++;
+   }
+   elapsed = ecore_time_get() - start_time;
+   allocs = _allocs - allocs;
+
+   ede_pathfinder_stats_get(&st);
+   for (q = 0; q < PATHFINDER_QUERY_COUNT; q++)
+      expanded += st.expanded[q];
+
+   printf("  %-10s %12.1f %12.1f %10.2f %10.2f %6d/%d\n", engine->name,
+          (double)expanded / map->queries_count,
+          elapsed * 1000000 / map->queries_count,
+          (double)allocs / map->queries_count,
+          setup * 1000, found, map->queries_count);
+
+   if (engine->landmarks)
+      ede_pathfinder_landmarks_build(map->rows, map->cols, 0, NULL);
+   return found;
+}
+
+/**
+ * Run the map with all the engines, and check them against astar.
+ * @return EINA_FALSE if they don't agree
+ */
+static Eina_Bool
+_map_run(Map *map)
+{
+   Ede_Walkable_Map *walkable;
+   Eina_Bool ok = EINA_TRUE;
+   unsigned int i;
+   int r, c, q, found, found_first = 0, wrong;
+   int *costs, *costs_first; // of every query, by the engine and by astar
+
+   costs_first = malloc(2 * map->queries_count * sizeof(int));
+   if (!costs_first)
+   {
+      printf("  FAIL: no memory for the costs of %s\n", map->name);
+      return EINA_FALSE;
+   }
+   costs = costs_first + map->queries_count;
+
+   // the bitmap, as the game use it
+   _map = map;
+   walkable = ede_pathfinder_walkable_map_new(map->rows, map->cols);
+   if (walkable)
+   {
+      for (r = 0; r < map->rows; r++)
+         for (c = 0; c < map->cols; c++)
+            ede_pathfinder_walkable_map_set(walkable, r, c, _walkable_get(r, c));
+      ede_pathfinder_walkable_map_use(walkable, _walkable_get);
+   }
+
+   printf("%s, %d queries\n", map->name, map->queries_count);
+   printf("  %-10s %12s %12s %10s %10s %9s\n", "mode",
+          "expanded/q", "usec/q", "allocs/q", "setup ms", "found");
+   for (i = 0; i < sizeof(engines) / sizeof(engines[0]); i++)
+   {
+      found = _engine_run(map, &engines[i], i ? costs : costs_first);
+      if (i == 0)
+      {
+         found_first = found;
+         continue;
+      }
+
+      // the shortest paths must all cost the same, the other modes can
+      // only be checked to find one where astar does
+      if (engines[i].exact && !_smooth)
+      {
+         for (wrong = 0, q = 0; q < map->queries_count; q++)
+            if (costs[q] != costs_first[q])
+            {
+               if (!wrong)
+                  printf("  FAIL: %s cost %d on query %d, %s %d\n",
+                         engines[i].name, costs[q], q, engines[0].name,
+                         costs_first[q]);
+               wrong++;
+            }
+         if (wrong)
+         {
+            printf("  FAIL: %s wrong on %d queries\n", engines[i].name, wrong);
+            ok = EINA_FALSE;
+         }
+      }
+      else if (found != found_first)
+      {
+         printf("  FAIL: %s found %d paths, %s %d\n", engines[i].name, found,
+                engines[0].name, found_first);
+         ok = EINA_FALSE;
+      }
+   }
+   printf("\n");
+
+   ede_pathfinder_walkable_map_use(NULL, NULL);
+   ede_pathfinder_walkable_map_free(walkable);
+   _map = NULL;
+   free(costs_first);
+   return ok;
+}
+
+static void
+_usage(const char *prog)
+{
+   printf("Usage: %s [-n queries] [-m max size] [-r seed] [-b] [-s] [file.level ...]\n"
+          "  -n  queries for every map (default %d)\n"
+          "  -m  biggest side of the generated maps (default %d)\n"
+          "  -r  seed of the generated maps and queries\n"
+          "  -b  use the bucket queue instead of the binary heap\n"
+          "  -s  smooth the paths found\n",
+          prog, BENCH_QUERIES, BENCH_MAX_SIZE);
+}
+
+int
+main(int argc, char **argv)
+{
+   Map *map;
+   unsigned int i;
+   int opt, queries = BENCH_QUERIES, max_size = BENCH_MAX_SIZE;
+   int ret = 0;
+
+   eina_init();
+   ecore_init();
+
+   ede_log_domain = eina_log_domain_register("ede", EINA_COLOR_GREEN);
+   if (ede_log_domain < 0)
+   {
+      EINA_LOG_CRIT("could not create log domain 'ede'.");
+      exit(1);
+   }
+   ede_pathfinder_init();
+
+   while ((opt = getopt(argc, argv, "n:m:r:bsh")) != -1)
+      switch (opt)
+      {
+         case 'n': queries = atoi(optarg); break;
+         case 'm': max_size = atoi(optarg); break;
+         case 'r': _seed = strtoul(optarg, NULL, 10); break;
+         case 'b': ede_pathfinder_queue_set(PATHFINDER_QUEUE_BUCKETS); break;
+         case 's':
+            ede_pathfinder_smoothing_set(EINA_TRUE);
+            _smooth = EINA_TRUE;
+            break;
+         default: _usage(argv[0]); goto shutdown;
+      }
+   if (queries < 1) queries = 1;
+   if (_seed == 0) _seed = 1;
+
+   if (optind < argc)
+   {
+      // the given levels
+      for (; optind < argc; optind++)
+         if ((map = _map_level_load(argv[optind], queries)))
+         {
+            if (!_map_run(map)) ret = 1;
+            _map_free(map);
+         }
+   }
+   else
+   {
+      // generated mazes and open fields of growing size
+      for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+      {
+         if (sizes[i][0] > max_size || sizes[i][1] > max_size)
+            break;
+         if ((map = _map_maze_new(sizes[i][1], sizes[i][0], queries)))
+         {
+            if (!_map_run(map)) ret = 1;
+            _map_free(map);
+         }
+         if ((map = _map_field_new(sizes[i][1], sizes[i][0], queries)))
+         {
+            if (!_map_run(map)) ret = 1;
+            _map_free(map);
+         }
+      }
+   }
+
+shutdown:
+   ede_pathfinder_shutdown();
+   eina_log_domain_unregister(ede_log_domain);
+   ede_log_domain = -1;
+   ecore_shutdown();
+   eina_shutdown();
+   return ret;
+}
@@ -44,8 +44,7 @@ struct _Ede_Bullet {
    Evas_Object *obj;
    float x, y; /** current position */
    int w, h; /** sprite size in pixel */
-   Ede_Enemy *target; /** target enemy, or NULL if the bullet is 'lost' */
-   int target_id; /** target enemy born_count, used to check if the target is died/reborn  */
+   Ede_Enemy_Handle target; /** target enemy, slot -1 if the bullet is 'lost' */
    int dest_x, dest_y; /** destination point, in pixel */
    int speed; /** bullet speed */
    int damage; /** bullet damage */
@@ -133,8 +132,7 @@ ede_bullet_add(int start_x, int start_y, Ede_Enemy *target, int speed, int damag
 
    b->speed = speed;
    b->damage = damage;
-   b->target = target;
-   b->target_id = target->born_count;
+   b->target = ede_enemy_handle_get(target);
    b->x = start_x - b->w / 2;
    b->y = start_y - b->h / 2;
 
@@ -150,25 +148,28 @@ EAPI void
 ede_bullet_one_step_all(double time)
 {
    Ede_Bulllet *b;
+   Ede_Enemy *target;
    Eina_List *l, *ll;
    float distance;
 
    EINA_LIST_FOREACH_SAFE(bullets, l, ll, b)
    {
       // update bullet destination
-      if (b->target)
+      target = NULL;
+      if (b->target.slot >= 0)
       {
-         if (b->target->born_count != b->target_id)
+         target = ede_enemy_handle_resolve(b->target);
+         if (!target)
          {
             // target is dead, mark the bullet a 'lost'
-            b->target = NULL;
+            b->target.slot = -1;
             _count_lost++;
          }
          else
          {
             // track target position
-            b->dest_x = b->target->x;
-            b->dest_y = b->target->y;
+            b->dest_x = target->x;
+            b->dest_y = target->y;
          }
       }
 
@@ -178,8 +179,8 @@ ede_bullet_one_step_all(double time)
       // target reached
       if (distance < 10)
       {
-         if (b->target)
-            ede_enemy_hit(b->target, b->damage);
+         if (target)
+            ede_enemy_hit(target, b->damage);
          evas_object_hide(b->obj);
          EINA_LIST_PUSH(inactives, b);
          bullets = eina_list_remove_list(bullets, l);
@@ -22,6 +22,9 @@
 #include <stdio.h>
 #include <Eina.h>
 #include <Ecore.h>
+#if defined(__AVX__) || defined(__SSE__)
+#include <immintrin.h>
+#endif
 
 
 #include "ede.h"
@@ -43,26 +46,360 @@
 #define GAUGE_W 20
 #define GAUGE_H 4
 
+#define ENEMY_BLOCK_SHIFT 6 // the pool grows by 64 enemies at a time
+#define ENEMY_BLOCK (1 << ENEMY_BLOCK_SHIFT)
+
+#define WALKER_SNAP 0.01 // (squared) a walker is on the hop just there
+#define FLYER_SNAP 100.0 // (squared) a flyer is on the hop 10 pixel before
+
+#define SPATIAL_CELL_SHIFT 6 // the proximity grid cells are 64 pixel wide
+#define SPATIAL_CELL (1 << SPATIAL_CELL_SHIFT)
+#define NO_DISTANCE 999999   // reported when there is no enemy to measure
+
+#if defined(__AVX__)
+#define MOVEMENT_KERNEL "avx"
+#elif defined(__SSE__)
+#define MOVEMENT_KERNEL "sse"
+#else
+#define MOVEMENT_KERNEL "scalar"
+#endif
+
+/* The hot movement state of the alive enemies, by pool index. One array for
+ * each field, so all the enemies are moved in a single vectorized pass. */
+typedef struct _Movement Movement;
+struct _Movement
+{
+   float *x, *y;           // current position, in pixel
+   float *vx, *vy;         // velocity, in pixel per second
+   float *dest_x, *dest_y; // center of the next hop (the one we are approaching)
+   float *snap;            // the hop is reached closer than this (squared)
+   unsigned char *reached; // the hop is reached, time to head to the next one
+};
+
+/* Uniform grid of the enemies positions, for the proximity queries. Rebuilt
+ * at the end of every step, the enemies of a cell are contiguous. */
+typedef struct _Spatial Spatial;
+struct _Spatial
+{
+   int x0, y0;       // origin of the grid, in pixel
+   int rows, cols;   // size of the grid, in cells
+   int *start;       // first item of each cell, rows * cols + 1
+   Ede_Enemy **items; // the enemies, sorted by cell
+   float *x, *y;     // ...and their positions
+   int *cell;        // temp: the cell of each alive enemy
+   float *d2;        // temp: the distances of the k nearest
+   int count;        // items in the grid
+   int cells_size, items_size, d2_size; // allocated
+};
+
+/* How many enemies are in each cell of the level, for the placement checks */
+typedef struct _Occupancy Occupancy;
+struct _Occupancy
+{
+   int rows, cols;       // size of the level the table is allocated for
+   unsigned short *count; // enemies in each cell, rows * cols
+};
+
 
 /* Local subsystem vars */
-static Eina_List *deads = NULL;
-static Eina_List *alives = NULL;
+static Ede_Enemy **_pool = NULL;  // all the enemies: the alives, then the deads
+static int _pool_count = 0;       // enemies in the pool
+static int _alives_count = 0;     // the first ones in the pool
+static Ede_Enemy **_blocks = NULL; // the enemies memory, never moved (by slot)
+static int _blocks_count = 0;
+static Movement _mv;              // the movement state, as large as the pool
+static float ** const _mv_arrays[] = {
+   &_mv.x, &_mv.y, &_mv.vx, &_mv.vy, &_mv.dest_x, &_mv.dest_y, &_mv.snap
+};
+#define MV_ARRAYS_COUNT (int)(sizeof(_mv_arrays) / sizeof(_mv_arrays[0]))
+static Spatial _spatial;          // where the enemies are, for the towers
+static Occupancy _occupancy;      // where the enemies are, for the placement
 static int _count_spawned = 0;
 static int _count_killed = 0;
+static int _count_shared = 0; // paths taken from an other enemy, without searching
+static Ede_Enemy *_waiting = NULL; // the enemies waiting for a path job
+static Eina_Bool _shared_dirty = EINA_TRUE; // the flow field (or the HPA* graph) must be rebuilt before use
 
 /* Local subsystem callbacks */
+static Eina_Bool _standard_enemy_hop(Ede_Enemy *e);
+
+static void
+_waiting_add(Ede_Enemy *e)
+{
+   e->wait_prev = NULL;
+   e->wait_next = _waiting;
+   if (_waiting) _waiting->wait_prev = e;
+   _waiting = e;
+}
+
+static void
+_waiting_del(Ede_Enemy *e)
+{
+   if (e->wait_prev) e->wait_prev->wait_next = e->wait_next;
+   else if (_waiting == e) _waiting = e->wait_next;
+   if (e->wait_next) e->wait_next->wait_prev = e->wait_prev;
+   e->wait_prev = e->wait_next = NULL;
+}
+
+/**
+ * Cancel the path job of the enemy (if any), it is not waiting anymore.
+ */
+static void
+_path_job_cancel(Ede_Enemy *e)
+{
+   if (!e->job) return;
+   ede_pathfinder_job_cancel(e->job);
+   e->job = NULL;
+   _waiting_del(e);
+}
+
+/**
+ * Release all the enemy resources, the enemy memory is in the pool blocks.
+ */
 static void
 _enemy_del(Ede_Enemy *e)
 {
    EDE_OBJECT_DEL(e->obj);
    EDE_OBJECT_DEL(e->o_gauge1);
    EDE_OBJECT_DEL(e->o_gauge2);
+   _path_job_cancel(e);
    if (e->path)
    {
-      eina_list_free(e->path);
+      ede_pathfinder_path_unref(e->path);
       e->path = NULL;
    }
-   EDE_FREE(e);
+   if (e->route)
+   {
+      ede_pathfinder_path_unref(e->route);
+      e->route = NULL;
+   }
+}
+
+/**
+ * Resize the movement arrays, to follow the pool.
+ */
+static Eina_Bool
+_movement_resize(int size)
+{
+   unsigned char *reached;
+   float *array;
+   int i;
+
+   for (i = 0; i < MV_ARRAYS_COUNT; i++)
+   {
+      array = realloc(*_mv_arrays[i], size * sizeof(float));
+      if (!array) return EINA_FALSE;
+      *_mv_arrays[i] = array;
+   }
+   reached = realloc(_mv.reached, size);
+   if (!reached) return EINA_FALSE;
+   _mv.reached = reached;
+   return EINA_TRUE;
+}
+
+static void
+_movement_free(void)
+{
+   int i;
+
+   for (i = 0; i < MV_ARRAYS_COUNT; i++)
+      EDE_FREE(*_mv_arrays[i]);
+   EDE_FREE(_mv.reached);
+}
+
+/**
+ * Stop the enemy where it is, the next hop will be taken at the next step.
+ */
+static void
+_movement_stop(Ede_Enemy *e)
+{
+   int i = e->index;
+
+   _mv.dest_x[i] = _mv.x[i];
+   _mv.dest_y[i] = _mv.y[i];
+   _mv.vx[i] = _mv.vy[i] = 0;
+   _mv.snap[i] = 1;
+   _mv.reached[i] = 1;
+}
+
+/**
+ * Add a block of (dead) enemies to the pool. The enemies are in a block
+ * that never move, so they can be referenced by pointer or by slot.
+ */
+static Eina_Bool
+_pool_grow(void)
+{
+   Ede_Enemy **pool, **blocks, *block;
+   int i;
+
+   if (!_movement_resize(_pool_count + ENEMY_BLOCK)) goto error;
+   pool = realloc(_pool, (_pool_count + ENEMY_BLOCK) * sizeof(Ede_Enemy *));
+   if (!pool) goto error;
+   _pool = pool;
+   blocks = realloc(_blocks, (_blocks_count + 1) * sizeof(Ede_Enemy *));
+   if (!blocks) goto error;
+   _blocks = blocks;
+   block = calloc(ENEMY_BLOCK, sizeof(Ede_Enemy));
+   if (!block) goto error;
+
+   _blocks[_blocks_count++] = block;
+   for (i = 0; i < ENEMY_BLOCK; i++)
+   {
+      block[i].slot = block[i].index = _pool_count;
+      _pool[_pool_count++] = &block[i];
+   }
+   return EINA_TRUE;
+
+error:
+   CRITICAL("Failure to allocate mem for the enemies pool");
+   return EINA_FALSE;
+}
+
+/**
+ * Swap two enemies in the pool array (and their movement state).
+ */
+static inline void
+_pool_swap(int a, int b)
+{
+   Ede_Enemy *e = _pool[a];
+   unsigned char reached;
+   float tmp;
+   int i;
+
+   _pool[a] = _pool[b];
+   _pool[b] = e;
+   _pool[a]->index = a;
+   _pool[b]->index = b;
+
+   for (i = 0; i < MV_ARRAYS_COUNT; i++)
+   {
+      tmp = (*_mv_arrays[i])[a];
+      (*_mv_arrays[i])[a] = (*_mv_arrays[i])[b];
+      (*_mv_arrays[i])[b] = tmp;
+   }
+   reached = _mv.reached[a];
+   _mv.reached[a] = _mv.reached[b];
+   _mv.reached[b] = reached;
+}
+
+/**
+ * Give a new hierarchical route to the enemy (NULL to just release the old
+ * one). The enemy take the ownership of the given route reference.
+ */
+static void
+_route_set(Ede_Enemy *e, Ede_Path *route)
+{
+   if (e->route)
+      ede_pathfinder_path_unref(e->route);
+   e->route = route;
+   e->waypoint = route ? route->hops : NULL;
+}
+
+/**
+ * Give a new path to the enemy (NULL to just release the old one).
+ * The enemy take the ownership of the given path reference.
+ * The enemy leave the hop it was going to and head to the first one of the
+ * new path: with smoothed paths the old hop can be far away, behind the
+ * tower that caused the new path.
+ */
+static void
+_path_set(Ede_Enemy *e, Ede_Path *path)
+{
+   if (e->path)
+      ede_pathfinder_path_unref(e->path);
+   e->path = path;
+   e->hop = path ? path->hops : NULL;
+   _movement_stop(e);
+}
+
+/**
+ * Get the next hop of the path and advance the enemy cursor.
+ * @return EINA_FALSE if the path is finished
+ */
+static Eina_Bool
+_path_next_hop_get(Ede_Enemy *e, int *row, int *col)
+{
+   if (!e->path || e->hop >= e->path->hops + e->path->count)
+      return EINA_FALSE;
+
+   *row = EDE_PATH_HOP_ROW(*e->hop);
+   *col = EDE_PATH_HOP_COL(*e->hop);
+   e->hop++;
+   return EINA_TRUE;
+}
+
+/**
+ * Check if the enemy has no way to its target from where it is: its path (or
+ * route) is marked unreachable. It waits on its cell for a level change.
+ */
+static inline Eina_Bool
+_path_stuck(Ede_Enemy *e)
+{
+   return (e->path && e->path->unreachable) ||
+          (e->route && e->route->unreachable);
+}
+
+static void _path_recalc(Ede_Enemy *e);
+
+/**
+ * Make the enemy follow the given path (to its target) from the cell it is
+ * on, if the path pass on it (also between two hops of a smoothed path): the
+ * rest of a shortest path is the shortest path from there too. The enemy
+ * share the path, only the cursor is its own.
+ * @return EINA_FALSE if the enemy is not on the path
+ */
+static Eina_Bool
+_path_attach(Ede_Enemy *e, Ede_Path *path)
+{
+   int row, col, hop;
+
+   if (path->goal_row != e->target_row || path->goal_col != e->target_col)
+      return EINA_FALSE;
+
+   ede_gui_cell_get_at_coords(e->x, e->y, &row, &col);
+   hop = ede_pathfinder_path_hop_find(path, row, col);
+   if (hop < 0)
+      return EINA_FALSE;
+   _path_set(e, ede_pathfinder_path_ref(path));
+   e->hop = path->hops + hop;
+   return EINA_TRUE;
+}
+
+/**
+ * The new path requested by _path_recalc() is ready. The enemy has been
+ * walking the old one meanwhile, so continue from the cell it is on now.
+ */
+static void
+_path_job_done_cb(void *data, Ede_Path_Job *job, Ede_Path *path)
+{
+   Ede_Enemy *e = data;
+   Ede_Enemy *other, *next;
+
+   e->job = NULL;
+   _waiting_del(e);
+   if (!path || path->unreachable) return; // keep walking the old one
+
+   if (!_path_attach(e, path))
+   {
+      // the enemy is not on the new path anymore, ask again from here
+      _path_recalc(e);
+      return;
+   }
+
+   // the enemies still waiting for a path that are on this one (the ones of
+   // the same wave, after a mass recalc) just share it, so there is a single
+   // route for all of them and not one for each enemy
+   if (path->revision != ede_level_revision_get())
+      return;
+   for (other = _waiting; other; other = next)
+   {
+      next = other->wait_next;
+      if (_path_attach(other, path))
+      {
+         _path_job_cancel(other);
+         _count_shared++;
+      }
+   }
 }
 
 static void
@@ -70,26 +407,205 @@ _path_recalc(Ede_Enemy *e)
 {
    int row, col;
    Ede_Level *level;
+   Ede_Path *path;
+
+   // flyers go straight to the target, ignoring walls
+   if (e->hop_func != _standard_enemy_hop)
+      return;
 
    // get current enemy cell
    ede_gui_cell_get_at_coords(e->x, e->y, &row, &col);
 
-   //~ D("hops: %d [pos %d %d][goto %d %d]", eina_list_count(e->path), row, col, e->target_row, e->target_col);
-
-   // free old path
-   eina_list_free(e->path);
+   //~ D("hops: %d [pos %d %d][goto %d %d]", e->path->count, row, col, e->target_row, e->target_col);
 
-   // run the pathfinder
+   // the hierarchical route, the legs will be refined while walking
    level = ede_level_current_get();
-   e->path = ede_pathfinder(level->rows, level->cols,
-                  row, col, e->target_row, e->target_col,
-                  ede_level_walkable_get, 0, EINA_FALSE);
+   if (level->pathfinder == PATHFINDER_HPA)
+   {
+      path = ede_pathfinder_path_get(level->rows, level->cols,
+                                     row, col, e->target_row, e->target_col,
+                                     ede_level_walkable_get, PATHFINDER_HPA,
+                                     ede_level_revision_get());
+      if (!path || path->unreachable)
+      {
+         // keep walking the old one
+         if (path) ede_pathfinder_path_unref(path);
+         return;
+      }
+      _route_set(e, path);
+      _path_set(e, NULL);
+      return;
+   }
+
+   // request the new path, calculated by the pathfinder workers (or in the
+   // next frames, or taken from the cache), the old one is followed until
+   // the new one is ready
+   _path_job_cancel(e);
+   e->job = ede_pathfinder_job_add(level->rows, level->cols,
+                                   row, col, e->target_row, e->target_col,
+                                   ede_level_walkable_get, level->pathfinder,
+                                   ede_level_revision_get(),
+                                   _path_job_done_cb, e);
+   if (e->job)
+   {
+      _waiting_add(e);
+      return;
+   }
+
+   // can't wait, get the path now
+   path = ede_pathfinder_path_get(level->rows, level->cols,
+                                  row, col, e->target_row, e->target_col,
+                                  ede_level_walkable_get, level->pathfinder,
+                                  ede_level_revision_get());
+   if (!path || path->unreachable)
+   {
+      // keep walking the old one
+      if (path) ede_pathfinder_path_unref(path);
+      return;
+   }
+   _path_set(e, path);
 
    // TODO the travel from the current position (in pixel) from the first
    //      hop is not really defined, but it seems quiet good.
    //~ D("NEW PATH %d", eina_list_count(e->path));
 }
 
+static void
+_shared_update(void)
+{
+   Ede_Level *level;
+
+   level = ede_level_current_get();
+   if (level->pathfinder == PATHFINDER_FLOWFIELD)
+      // build the field toward home, shared by all the walking enemies
+      ede_pathfinder_flowfield_update(level->rows, level->cols,
+                                      level->home_row, level->home_col,
+                                      ede_level_walkable_get);
+   else if (level->pathfinder == PATHFINDER_HPA)
+      // build the clusters graph, shared by all the walking enemies
+      ede_pathfinder_hpa_build(level->rows, level->cols,
+                               ede_level_walkable_get);
+   _shared_dirty = EINA_FALSE;
+}
+
+/**
+ * Check if the enemy route pass near (or inside) the given rect of cells.
+ * Also the cells around the rect are checked, as the diagonal moves that
+ * cut the corners of the rect are affected too.
+ */
+static Eina_Bool
+_path_touch_area(Ede_Enemy *e, int row, int col, int rows, int cols)
+{
+   const int *hop;
+   int r, c, prev_r, prev_c;
+
+   ede_gui_cell_get_at_coords(e->x, e->y, &r, &c);
+   prev_r = r;
+   prev_c = c;
+   hop = e->hop;
+   while (1)
+   {
+      // the hops of a smoothed path can be far apart, check all the rect
+      // of cells around the segment that join the hop to the previous one
+      if ((r > prev_r ? r : prev_r) >= row - 1 &&
+          (r < prev_r ? r : prev_r) <= row + rows &&
+          (c > prev_c ? c : prev_c) >= col - 1 &&
+          (c < prev_c ? c : prev_c) <= col + cols)
+         return EINA_TRUE;
+      if (!e->path || hop >= e->path->hops + e->path->count) break;
+      prev_r = r;
+      prev_c = c;
+      r = EDE_PATH_HOP_ROW(*hop);
+      c = EDE_PATH_HOP_COL(*hop);
+      hop++;
+   }
+   return EINA_FALSE;
+}
+
+/**
+ * Stop a walking enemy that is heading into a cell not walkable anymore (a
+ * tower just placed there), it will head to the same hop again from the cell
+ * it is on, see _standard_enemy_next_hop_get().
+ */
+static void
+_path_hop_check(Ede_Enemy *e)
+{
+   int row, col, dest_row, dest_col;
+
+   if (e->hop_func != _standard_enemy_hop)
+      return;
+   ede_gui_cell_get_at_coords(e->x, e->y, &row, &col);
+   ede_gui_cell_get_at_coords(_mv.dest_x[e->index], _mv.dest_y[e->index],
+                              &dest_row, &dest_col);
+   if (ede_pathfinder_line_walkable(row, col, dest_row, dest_col,
+                                    ede_level_walkable_get))
+      return;
+   if (e->path && e->hop > e->path->hops) e->hop--;
+   _movement_stop(e);
+}
+
+/**
+ * Get the next hop (the next cell to go to) of a walking enemy. The enemy
+ * never walk into a cell that is not walkable (anymore): without a way to go
+ * the next hop is the cell it is on, to wait there for a new path.
+ * @return EINA_FALSE if the target is reached (the enemy is on its cell)
+ */
+static Eina_Bool
+_standard_enemy_next_hop_get(Ede_Enemy *e, int *row, int *col)
+{
+   Ede_Level *level = ede_level_current_get();
+   int cur_row, cur_col;
+
+   ede_gui_cell_get_at_coords(e->x, e->y, &cur_row, &cur_col);
+   if (level->pathfinder == PATHFINDER_FLOWFIELD)
+   {
+      // just follow the direction stored in the cell we are on
+      if (ede_pathfinder_flowfield_next(cur_row, cur_col, row, col))
+         return EINA_TRUE;
+      goto end;
+   }
+
+   while (!_path_next_hop_get(e, row, col))
+   {
+      // no way to the target from here, wait for a level change
+      if (_path_stuck(e))
+         goto wait;
+      // the current leg is finished, refine the next one of the route
+      if (!e->route || e->waypoint >= e->route->hops + e->route->count)
+         goto end;
+      _path_set(e, ede_pathfinder_path_get(level->rows, level->cols,
+                                           cur_row, cur_col,
+                                           EDE_PATH_HOP_ROW(*e->waypoint),
+                                           EDE_PATH_HOP_COL(*e->waypoint),
+                                           ede_level_walkable_get,
+                                           PATHFINDER_ASTAR,
+                                           ede_level_revision_get()));
+      e->waypoint++;
+   }
+
+   // the old path cross a tower placed after it was found, and the new one
+   // is not ready yet: wait here, heading to the same hop later
+   if (!ede_pathfinder_line_walkable(cur_row, cur_col, *row, *col,
+                                     ede_level_walkable_get))
+   {
+      e->hop--;
+      if (!e->job) _path_recalc(e);
+      goto wait;
+   }
+   return EINA_TRUE;
+
+end:
+   // the path is finished, but the target is only reached on its cell
+   if (cur_row == e->target_row && cur_col == e->target_col)
+      return EINA_FALSE;
+   if (level->pathfinder != PATHFINDER_FLOWFIELD && !e->job)
+      _path_recalc(e);
+wait:
+   *row = cur_row;
+   *col = cur_col;
+   return EINA_TRUE;
+}
+
 static void
 _gauge_recalc(Ede_Enemy *e)
 {
@@ -104,160 +620,498 @@ _gauge_recalc(Ede_Enemy *e)
    evas_object_resize(e->o_gauge2, val * GAUGE_W, GAUGE_H);
 }
 
+/**
+ * Head the enemy to the given point (the center of the next hop), at the
+ * given speed. The hop is reached when passed, or when closer than snap.
+ */
 static void
-_standard_enemy_step(Ede_Enemy *e, double time)
+_movement_head_to(Ede_Enemy *e, int dest_x, int dest_y, float speed, float snap)
 {
-   int row, col;
-   int dx, dy;
+   int i = e->index;
+   float dx, dy, distance;
+
+   dx = dest_x - _mv.x[i];
+   dy = dest_y - _mv.y[i];
+   distance = sqrtf(dx * dx + dy * dy);
+   _mv.dest_x[i] = dest_x;
+   _mv.dest_y[i] = dest_y;
+   _mv.vx[i] = distance > 0 ? dx / distance * speed : 0;
+   _mv.vy[i] = distance > 0 ? dy / distance * speed : 0;
+   _mv.snap[i] = snap;
+   _mv.reached[i] = 0;
+}
 
-   // if we don't have a destination (local movement inside a path), get a new
-   // dest from the path list
-   if (!e->dest_x)
-   {
-      // if the path list is empty then the target is reached !
-      if (eina_list_count(e->path) < 2)
-      {
-         ede_game_home_violated();
-         ede_enemy_kill(e);
-         return;
-      }
+/**
+ * Move all the first count enemies of the pool toward their hops, and flag
+ * the ones that reached it (they stop there, waiting a new hop).
+ * Walkers and flyers differ only in the velocity and in the snap distance,
+ * so there is a single branchless pass for all of them, 8 (AVX) or 4 (SSE)
+ * enemies at a time where available.
+ */
+static void
+_movement_run(int count, float time)
+{
+   float nx, ny, dot, ox, oy;
+   int i = 0;
+#if defined(__AVX__)
+   __m256 t8 = _mm256_set1_ps(time), zero8 = _mm256_setzero_ps();
+   int bits, j;
 
-      // pop 2 elements (row & col of the next path hop) from the path list
-      row = (int)(long)EINA_LIST_POP(e->path);
-      col = (int)(long)EINA_LIST_POP(e->path);
+   for (; i + 8 <= count; i += 8)
+   {
+      __m256 x = _mm256_loadu_ps(_mv.x + i), y = _mm256_loadu_ps(_mv.y + i);
+      __m256 vx = _mm256_loadu_ps(_mv.vx + i), vy = _mm256_loadu_ps(_mv.vy + i);
+      __m256 dx = _mm256_loadu_ps(_mv.dest_x + i), dy = _mm256_loadu_ps(_mv.dest_y + i);
+      __m256 px = _mm256_add_ps(x, _mm256_mul_ps(vx, t8));
+      __m256 py = _mm256_add_ps(y, _mm256_mul_ps(vy, t8));
+      __m256 d = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(dx, px), vx),
+                               _mm256_mul_ps(_mm256_sub_ps(dy, py), vy));
+      __m256 sx = _mm256_sub_ps(dx, x), sy = _mm256_sub_ps(dy, y);
+      __m256 d2 = _mm256_add_ps(_mm256_mul_ps(sx, sx), _mm256_mul_ps(sy, sy));
+      __m256 done = _mm256_or_ps(_mm256_cmp_ps(d, zero8, _CMP_LT_OQ),
+                                 _mm256_cmp_ps(d2, _mm256_loadu_ps(_mv.snap + i),
+                                               _CMP_LT_OQ));
+
+      _mm256_storeu_ps(_mv.x + i, _mm256_blendv_ps(px, dx, done));
+      _mm256_storeu_ps(_mv.y + i, _mm256_blendv_ps(py, dy, done));
+      bits = _mm256_movemask_ps(done);
+      for (j = 0; j < 8; j++)
+         _mv.reached[i + j] = (bits >> j) & 1;
+   }
+#elif defined(__SSE__)
+   __m128 t4 = _mm_set1_ps(time), zero4 = _mm_setzero_ps();
+   int bits, j;
 
-      // get destination center point in pixel
-      ede_gui_cell_coords_get(row, col, &e->dest_x, &e->dest_y, EINA_TRUE);
-      //~ D("New destination: row:%d col:%d (%d,&d)", row, col, e->dest_x, e->dest_y);
+   for (; i + 4 <= count; i += 4)
+   {
+      __m128 x = _mm_loadu_ps(_mv.x + i), y = _mm_loadu_ps(_mv.y + i);
+      __m128 vx = _mm_loadu_ps(_mv.vx + i), vy = _mm_loadu_ps(_mv.vy + i);
+      __m128 dx = _mm_loadu_ps(_mv.dest_x + i), dy = _mm_loadu_ps(_mv.dest_y + i);
+      __m128 px = _mm_add_ps(x, _mm_mul_ps(vx, t4));
+      __m128 py = _mm_add_ps(y, _mm_mul_ps(vy, t4));
+      __m128 d = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(dx, px), vx),
+                            _mm_mul_ps(_mm_sub_ps(dy, py), vy));
+      __m128 sx = _mm_sub_ps(dx, x), sy = _mm_sub_ps(dy, y);
+      __m128 d2 = _mm_add_ps(_mm_mul_ps(sx, sx), _mm_mul_ps(sy, sy));
+      __m128 done = _mm_or_ps(_mm_cmplt_ps(d, zero4),
+                              _mm_cmplt_ps(d2, _mm_loadu_ps(_mv.snap + i)));
+
+      _mm_storeu_ps(_mv.x + i, _mm_or_ps(_mm_and_ps(done, dx), _mm_andnot_ps(done, px)));
+      _mm_storeu_ps(_mv.y + i, _mm_or_ps(_mm_and_ps(done, dy), _mm_andnot_ps(done, py)));
+      bits = _mm_movemask_ps(done);
+      for (j = 0; j < 4; j++)
+         _mv.reached[i + j] = (bits >> j) & 1;
+   }
+#endif
 
-      // calc direction angle
-      // NOTE: enemy will follow a really simple path, so we can use this stupid
-      // but really fast approach
-      dx = e->dest_x - e->x;
-      dy = e->dest_y - e->y;
-      if (dx > 0)
-      {
-         if (dy < 0) e->angle = 45;       // top-right
-         else if (dy == 0) e->angle = 90; // right
-         else e->angle = 135;             // bottom-right
-      }
-      else if (dx < 0)
+   // the remaining ones (or all, without SIMD)
+   for (; i < count; i++)
+   {
+      nx = _mv.x[i] + _mv.vx[i] * time;
+      ny = _mv.y[i] + _mv.vy[i] * time;
+      // passed the hop: the way left points backward
+      dot = (_mv.dest_x[i] - nx) * _mv.vx[i] + (_mv.dest_y[i] - ny) * _mv.vy[i];
+      ox = _mv.dest_x[i] - _mv.x[i];
+      oy = _mv.dest_y[i] - _mv.y[i];
+      if (dot < 0 || ox * ox + oy * oy < _mv.snap[i])
       {
-         if (dy < 0) e->angle = 315;       // top-left
-         else if (dy == 0) e->angle = 270; // left
-         else e->angle = 225;              // bottom-left
+         _mv.x[i] = _mv.dest_x[i];
+         _mv.y[i] = _mv.dest_y[i];
+         _mv.reached[i] = 1;
       }
       else
       {
-         if (dy > 0) e->angle = 180;        // bottom
-         else e->angle = 0;                 // top
+         _mv.x[i] = nx;
+         _mv.y[i] = ny;
+         _mv.reached[i] = 0;
       }
-      //~ D("angle: %d [dx: %d dy: %d]", e->angle, dx, dy);
-   }
-
-
-   // calc the new position (...another stupid but really fast method)
-   switch (e->angle)
-   {
-      case 0: // going up
-         e->y -= time * e->speed * 1.41;
-         break;
-      case 45: // going up-right
-         e->x += time * e->speed;
-         e->y -= time * e->speed;
-         break;
-      case 90: // going right
-         e->x += time * e->speed * 1.41;
-         break;
-      case 135: // going down-right
-         e->x += time * e->speed;
-         e->y += time * e->speed;
-         break;
-      case 180: // going down
-         e->y += time * e->speed * 1.41;
-         break;
-      case 225: // going down-left
-         e->x -= time * e->speed;
-         e->y += time * e->speed;
-         break;
-      case 270: // going left
-         e->x -= time * e->speed * 1.41;
-         break;
-      case 315: // going up-left
-         e->x -= time * e->speed;
-         e->y -= time * e->speed;
-         break;
-      default:
-         break;
-   }
-
-   // hop reached ?
-   #define MOVE_TO_TARGET() { e->x = e->dest_x; e->y = e->dest_y; e->dest_x = 0; }
-   if ((e->angle == 45 || e->angle == 90 || e->angle == 135) && (e->x >= e->dest_x))
-      MOVE_TO_TARGET()
-   else if ((e->angle == 225 || e->angle == 270 || e->angle == 315) && (e->x <= e->dest_x))
-      MOVE_TO_TARGET()
-   else if (e->angle == 0 && e->y <= e->dest_y)
-      MOVE_TO_TARGET()
-   else if (e->angle == 180 && e->y >= e->dest_y)
-      MOVE_TO_TARGET()
+   }
+}
+
+static Eina_Bool
+_standard_enemy_hop(Ede_Enemy *e)
+{
+   int row, col, dest_x, dest_y;
+   int dx, dy;
+
+   // if there are no more hops then the target is reached !
+   if (!_standard_enemy_next_hop_get(e, &row, &col))
+      return EINA_FALSE;
+
+   // get destination center point in pixel
+   ede_gui_cell_coords_get(row, col, &dest_x, &dest_y, EINA_TRUE);
+   //~ D("New destination: row:%d col:%d (%d,&d)", row, col, dest_x, dest_y);
+
+   // calc direction angle
+   // NOTE: enemy will follow a really simple path, so we can use this stupid
+   // but really fast approach (but for the segments of the smoothed paths)
+   dx = dest_x - e->x;
+   dy = dest_y - e->y;
+   if (dx && dy && abs(dx) != abs(dy))
+      e->angle = ede_util_angle_calc(e->x, e->y, dest_x, dest_y);
+   else if (dx > 0)
+   {
+      if (dy < 0) e->angle = 45;       // top-right
+      else if (dy == 0) e->angle = 90; // right
+      else e->angle = 135;             // bottom-right
+   }
+   else if (dx < 0)
+   {
+      if (dy < 0) e->angle = 315;       // top-left
+      else if (dy == 0) e->angle = 270; // left
+      else e->angle = 225;              // bottom-left
+   }
+   else
+   {
+      if (dy > 0) e->angle = 180;        // bottom
+      else e->angle = 0;                 // top
+   }
+   //~ D("angle: %d [dx: %d dy: %d]", e->angle, dx, dy);
+
+   // a cell in a straight move, 1.41 cells in a diagonal one, at the same
+   // time (and the segments of the smoothed paths at the same speed)
+   _movement_head_to(e, dest_x, dest_y, e->speed * 1.41, WALKER_SNAP);
+   return EINA_TRUE;
+}
+
+static Eina_Bool
+_flyer_enemy_hop(Ede_Enemy *e)
+{
+   int row, col, dest_x, dest_y;
+
+   // if the path is finished then the target is reached !
+   if (!_path_next_hop_get(e, &row, &col))
+      return EINA_FALSE;
+
+   // get destination center point in pixel
+   ede_gui_cell_coords_get(row, col, &dest_x, &dest_y, EINA_TRUE);
+   //~ D("New destination: row:%d col:%d (%d,%d)", row, col, dest_x, dest_y);
+
+   // calc direction angle
+   e->angle = ede_util_angle_calc(e->x, e->y, dest_x, dest_y);
+   _movement_head_to(e, dest_x, dest_y, e->speed, FLYER_SNAP);
+   return EINA_TRUE;
+}
+
+/**
+ * The enemy reached its hop, head to the next one.
+ * @return EINA_FALSE if the target is reached (and so the enemy is dead)
+ */
+static Eina_Bool
+_enemy_hop(Ede_Enemy *e)
+{
+   if (e->hop_func(e))
+      return EINA_TRUE;
+
+   ede_game_home_violated();
+   ede_enemy_kill(e);
+   return EINA_FALSE;
+}
 
+static void
+_enemy_render(Ede_Enemy *e)
+{
    // apply the new position
    //~ D("%f %f",e->position.x, e->position.y);
-   dx = (int)(e->x + 0.5) - e->w / 2;
-   dy = (int)(e->y + 0.5) - e->h / 2;
-   evas_object_move(e->obj, dx, dy);
+   evas_object_move(e->obj, (int)(e->x + 0.5) - e->w / 2,
+                            (int)(e->y + 0.5) - e->h / 2);
 
    // TODO need to optimize rotation...or made prerotated edje version :(
    ede_util_obj_rotate(e->obj, e->angle);// TODO really I need to rotate everytime ???
+   _gauge_recalc(e);
 }
 
-static void
-_flyer_enemy_step(Ede_Enemy *e, double time)
+/**************   CELL OCCUPANCY   *****************************************/
+/**
+ * Get the index of the cell at the given position.
+ * @return -1 if the position is out of the level
+ */
+static inline int
+_occupancy_cell_get(float x, float y)
 {
    int row, col;
-   float distance;
 
-   if (!e->dest_x)
+   if (!ede_gui_cell_get_at_coords(x, y, &row, &col) ||
+       row < 0 || col < 0 || row >= _occupancy.rows || col >= _occupancy.cols)
+      return -1;
+   return row * _occupancy.cols + col;
+}
+
+/**
+ * Move the enemy in the given cell (-1 to just take it out of its cell).
+ */
+static inline void
+_occupancy_move(Ede_Enemy *e, int cell)
+{
+   if (cell == e->cell) return;
+   if (e->cell >= 0) _occupancy.count[e->cell]--;
+   if (cell >= 0) _occupancy.count[cell]++;
+   e->cell = cell;
+}
+
+/**
+ * Alloc the table for the current level size (if changed), and recount the
+ * alive enemies in it.
+ */
+static Eina_Bool
+_occupancy_check(void)
+{
+   Ede_Level *level = ede_level_current_get();
+   unsigned short *tmp;
+   int i;
+
+   if (level->rows == _occupancy.rows && level->cols == _occupancy.cols)
+      return EINA_TRUE;
+
+   D("Occupancy table for a %dx%d level", level->rows, level->cols);
+   tmp = calloc(level->rows * level->cols, sizeof(unsigned short));
+   if (!tmp && level->rows * level->cols > 0)
    {
-      // if the path list is empty then the target is reached !
-      if (eina_list_count(e->path) < 2)
-      {
-         ede_game_home_violated();
-         ede_enemy_kill(e);
-         return;
-      }
+      CRITICAL("Failure to allocate mem for the occupancy table");
+      return EINA_FALSE;
+   }
+   EDE_FREE(_occupancy.count);
+   _occupancy.count = tmp;
+   _occupancy.rows = level->rows;
+   _occupancy.cols = level->cols;
 
-      // pop 2 elements (row & col of the next path hop) from the path list
-      row = (int)(long)EINA_LIST_POP(e->path);
-      col = (int)(long)EINA_LIST_POP(e->path);
+   for (i = 0; i < _alives_count; i++)
+   {
+      _pool[i]->cell = -1;
+      _occupancy_move(_pool[i], _occupancy_cell_get(_mv.x[i], _mv.y[i]));
+   }
+   return EINA_TRUE;
+}
 
-      // get destination center point in pixel
-      ede_gui_cell_coords_get(row, col, &e->dest_x, &e->dest_y, EINA_TRUE);
-      //~ D("New destination: row:%d col:%d (%d,%d)", row, col, e->dest_x, e->dest_y);
+/**************   PROXIMITY GRID   ******************************************/
+static void
+_spatial_free(void)
+{
+   Spatial *g = &_spatial;
+
+   EDE_FREE(g->start);
+   EDE_FREE(g->items);
+   EDE_FREE(g->x);
+   EDE_FREE(g->y);
+   EDE_FREE(g->cell);
+   EDE_FREE(g->d2);
+   memset(g, 0, sizeof(Spatial));
+}
 
-      // calc direction angle
-      e->angle = ede_util_angle_calc(e->x, e->y, e->dest_x, e->dest_y);
+/**
+ * Put all the alive enemies in the grid (a counting sort by cell). The grid
+ * cover just the rect where the enemies are.
+ */
+static void
+_spatial_rebuild(void)
+{
+   Spatial *g = &_spatial;
+   float min_x, min_y, max_x, max_y;
+   int i, c, cells;
+   void *tmp;
+
+   g->count = 0;
+   if (_alives_count == 0)
+      return;
+
+   min_x = max_x = _mv.x[0];
+   min_y = max_y = _mv.y[0];
+   for (i = 1; i < _alives_count; i++)
+   {
+      if (_mv.x[i] < min_x) min_x = _mv.x[i];
+      if (_mv.x[i] > max_x) max_x = _mv.x[i];
+      if (_mv.y[i] < min_y) min_y = _mv.y[i];
+      if (_mv.y[i] > max_y) max_y = _mv.y[i];
+   }
+   g->x0 = (int)min_x;
+   g->y0 = (int)min_y;
+   g->cols = (((int)max_x - g->x0) >> SPATIAL_CELL_SHIFT) + 1;
+   g->rows = (((int)max_y - g->y0) >> SPATIAL_CELL_SHIFT) + 1;
+
+   // alloc/realloc the tables if they are too small
+   cells = g->rows * g->cols;
+   if (cells + 1 > g->cells_size)
+   {
+      tmp = realloc(g->start, (cells + 1) * sizeof(int));
+      if (!tmp) goto error;
+      g->start = tmp;
+      g->cells_size = cells + 1;
+   }
+   if (_alives_count > g->items_size)
+   {
+      tmp = realloc(g->items, _pool_count * sizeof(Ede_Enemy *));
+      if (!tmp) goto error;
+      g->items = tmp;
+      tmp = realloc(g->x, _pool_count * sizeof(float));
+      if (!tmp) goto error;
+      g->x = tmp;
+      tmp = realloc(g->y, _pool_count * sizeof(float));
+      if (!tmp) goto error;
+      g->y = tmp;
+      tmp = realloc(g->cell, _pool_count * sizeof(int));
+      if (!tmp) goto error;
+      g->cell = tmp;
+      g->items_size = _pool_count;
+   }
+
+   // count the enemies of each cell, sum them up to the end of each cell,
+   // then fill the cells backward: start[c] ends up on the first of c
+   memset(g->start, 0, (cells + 1) * sizeof(int));
+   for (i = 0; i < _alives_count; i++)
+   {
+      c = (((int)_mv.y[i] - g->y0) >> SPATIAL_CELL_SHIFT) * g->cols +
+          (((int)_mv.x[i] - g->x0) >> SPATIAL_CELL_SHIFT);
+      g->cell[i] = c;
+      g->start[c]++;
+   }
+   for (c = 1; c < cells; c++)
+      g->start[c] += g->start[c - 1];
+   for (i = _alives_count - 1; i >= 0; i--)
+   {
+      c = --g->start[g->cell[i]];
+      g->items[c] = _pool[i];
+      g->x[c] = _mv.x[i];
+      g->y[c] = _mv.y[i];
    }
+   g->start[cells] = _alives_count;
+   g->count = _alives_count;
+   return;
 
-   // calc distance from target
-   distance = ede_util_distance_calc(e->dest_x, e->dest_y, e->x, e->y);
+error:
+   CRITICAL("Failure to allocate mem for the proximity grid");
+}
 
-   // destination reached
-   if (distance < 10)
+/**
+ * Add the enemies of the given cell, closer than radius2 (squared), to the
+ * k nearest found so far (sorted, nearest first).
+ */
+static void
+_spatial_cell_nearest(Spatial *g, int row, int col, float x, float y,
+                      float radius2, int k, Ede_Enemy **found, float *found_d2,
+                      int *count)
+{
+   float dx, dy, d2;
+   int i, j, c;
+
+   if (row < 0 || col < 0 || row >= g->rows || col >= g->cols)
+      return;
+
+   c = row * g->cols + col;
+   for (i = g->start[c]; i < g->start[c + 1]; i++)
    {
-      e->x = e->dest_x; e->y = e->dest_y; e->dest_x = 0;
+      if (g->items[i]->killed) continue;
+      dx = g->x[i] - x;
+      dy = g->y[i] - y;
+      d2 = dx * dx + dy * dy;
+      if (d2 >= radius2) continue;
+      if (*count < k) (*count)++;
+      else if (d2 >= found_d2[k - 1]) continue;
+      for (j = *count - 1; j > 0 && found_d2[j - 1] > d2; j--)
+      {
+         found[j] = found[j - 1];
+         found_d2[j] = found_d2[j - 1];
+      }
+      found[j] = g->items[i];
+      found_d2[j] = d2;
    }
-   else
+}
+
+/**
+ * Find the k nearest enemies to the point, closer than radius2 (squared).
+ * The cells are visited in rings around the point, until no nearer enemy
+ * can be found.
+ * @return the number of enemies found (sorted, nearest first)
+ */
+static int
+_spatial_nearest(float x, float y, float radius2, int k,
+                 Ede_Enemy **found, float *found_d2)
+{
+   Spatial *g = &_spatial;
+   float cx, cy, left, top, bound, side;
+   int ring, row, col, qr, qc, count = 0;
+
+   if (g->count == 0 || k < 1)
+      return 0;
+
+   // the rings are around the point of the grid nearest to the given one
+   // (that is also nearer than the given one to all the enemies)
+   left = g->x0;
+   top = g->y0;
+   cx = x < left ? left : x;
+   cy = y < top ? top : y;
+   if (cx > left + g->cols * SPATIAL_CELL) cx = left + g->cols * SPATIAL_CELL;
+   if (cy > top + g->rows * SPATIAL_CELL) cy = top + g->rows * SPATIAL_CELL;
+   qc = ((int)cx - g->x0) >> SPATIAL_CELL_SHIFT;
+   qr = ((int)cy - g->y0) >> SPATIAL_CELL_SHIFT;
+   if (qc >= g->cols) qc = g->cols - 1;
+   if (qr >= g->rows) qr = g->rows - 1;
+
+   for (ring = 0; ; ring++)
    {
-      // calc new position
-      e->x += (e->dest_x - e->x) / distance * time * e->speed; // TODO a simpler way ??
-      e->y += (e->dest_y - e->y) / distance * time * e->speed;
+      // the enemies in this ring (and beyond) are not nearer than the
+      // sides of the rings already visited, stop if nothing better is there
+      if (ring > 0)
+      {
+         bound = INFINITY;
+         if (qc - ring >= 0)
+         {
+            side = cx - (left + (qc - ring + 1) * SPATIAL_CELL);
+            if (side < bound) bound = side;
+         }
+         if (qc + ring < g->cols)
+         {
+            side = left + (qc + ring) * SPATIAL_CELL - cx;
+            if (side < bound) bound = side;
+         }
+         if (qr - ring >= 0)
+         {
+            side = cy - (top + (qr - ring + 1) * SPATIAL_CELL);
+            if (side < bound) bound = side;
+         }
+         if (qr + ring < g->rows)
+         {
+            side = top + (qr + ring) * SPATIAL_CELL - cy;
+            if (side < bound) bound = side;
+         }
+         if (bound == INFINITY) // all the grid has been visited
+            break;
+         if (bound * bound >= radius2 ||
+             (count == k && bound * bound >= found_d2[k - 1]))
+            break;
+      }
 
-      evas_object_move(e->obj, e->x - e->w / 2 + 0.5, e->y - e->h / 2 + 0.5);
-      // TODO need to optimize rotation...or made prerotated edje version :(
-      ede_util_obj_rotate(e->obj, e->angle);// TODO really I need to rotate everytime ???
+      for (row = qr - ring; row <= qr + ring; row++)
+         if (row == qr - ring || row == qr + ring)
+            for (col = qc - ring; col <= qc + ring; col++)
+               _spatial_cell_nearest(g, row, col, x, y, radius2, k,
+                                     found, found_d2, &count);
+         else
+         {
+            _spatial_cell_nearest(g, row, qc - ring, x, y, radius2, k,
+                                  found, found_d2, &count);
+            _spatial_cell_nearest(g, row, qc + ring, x, y, radius2, k,
+                                  found, found_d2, &count);
+         }
    }
+   return count;
+}
+
+static Ede_Enemy *
+_nearest_get(int x, int y, float radius2, int *angle, int *distance)
+{
+   Ede_Enemy *nearest = NULL;
+   float d2;
+
+   if (_spatial_nearest(x, y, radius2, 1, &nearest, &d2) == 0)
+   {
+      if (distance) *distance = NO_DISTANCE;
+      return NULL;
+   }
+   if (angle)
+      *angle = ede_util_angle_calc(x, y, nearest->x, nearest->y);
+   if (distance)
+      *distance = sqrtf(d2);
+   return nearest;
 }
 
 /* Externally accessible functions */
@@ -271,13 +1125,20 @@ ede_enemy_init(void)
 EAPI Eina_Bool
 ede_enemy_shutdown(void)
 {
-   Ede_Enemy *e;
+   int i;
 
    D(" ");
-   EINA_LIST_FREE(deads, e)
-      _enemy_del(e);
-   EINA_LIST_FREE(alives, e)
-      _enemy_del(e);
+   for (i = 0; i < _pool_count; i++)
+      _enemy_del(_pool[i]);
+   for (i = 0; i < _blocks_count; i++)
+      free(_blocks[i]);
+   EDE_FREE(_blocks);
+   EDE_FREE(_pool);
+   _movement_free();
+   _spatial_free();
+   EDE_FREE(_occupancy.count);
+   _occupancy.rows = _occupancy.cols = 0;
+   _blocks_count = _pool_count = _alives_count = 0;
    return EINA_TRUE;
 }
 
@@ -289,16 +1150,17 @@ ede_enemy_spawn(const char *type, int speed, int strength, int bucks,
    Ede_Level *level;
    Ede_Enemy *e;
    char buf[PATH_MAX];
+   int hop;
 
-   //~ D("alives %d  deads %d", eina_list_count(alives), eina_list_count(deads));
+   //~ D("alives %d  deads %d", _alives_count, _pool_count - _alives_count);
 
-   // get an enemy from the deads list
-   e = EINA_LIST_POP(deads);
-   if (!e)
+   // get the first dead enemy, it become the last alive one
+   if (_alives_count == _pool_count && !_pool_grow())
+      return;
+   e = _pool[_alives_count++];
+   if (!e->obj)
    {
-      // or create a new one
-      e = EDE_NEW(Ede_Enemy);
-      if (!e) return;
+      // never used before, create its objects
 
       // main image
       e->obj = evas_object_image_filled_add(ede_gui_canvas_get());
@@ -325,71 +1187,96 @@ ede_enemy_spawn(const char *type, int speed, int strength, int bucks,
    // set the starting position
    int xi, yi;
    ede_gui_cell_coords_get(start_row, start_col, &xi, &yi, EINA_TRUE);
-   e->x = xi;
-   e->y = yi;
+   e->x = _mv.x[e->index] = xi;
+   e->y = _mv.y[e->index] = yi;
    e->target_row = end_row;
    e->target_col = end_col;
    e->killed = EINA_FALSE;
    e->born_count++;
+   e->cell = -1;
+   if (_occupancy_check())
+      _occupancy_move(e, _occupancy_cell_get(e->x, e->y));
 
    // reset the local destination
-   e->dest_x = e->dest_y = 0;
+   _movement_stop(e);
    e->speed = speed;
    e->bucks = bucks;
    e->energy = e->strength = strength;
 
-   // put the enemy in the alives list
-   EINA_LIST_PUSH(alives, e);
-
    if (streql(type, "flyer"))
    {
-      e->step_func = _flyer_enemy_step;
+      e->hop_func = _flyer_enemy_hop;
       // go directly to the target, ignoring walls
-      EINA_LIST_PUSH(e->path, (void*)e->target_col);
-      EINA_LIST_PUSH(e->path, (void*)e->target_row);
+      hop = EDE_PATH_HOP_PACK(e->target_row, e->target_col);
+      _path_set(e, ede_pathfinder_path_new(&hop, 1));
       evas_object_layer_set(e->obj, LAYER_FLYER);
       evas_object_layer_set(e->o_gauge1, LAYER_FLYER);
       evas_object_layer_set(e->o_gauge2, LAYER_FLYER);
    }
    else
    {
-      e->step_func = _standard_enemy_step;
-      // calc the route using the A* pathfinder
+      e->hop_func = _standard_enemy_hop;
       level = ede_level_current_get();
-      e->path = ede_pathfinder(level->rows, level->cols,
-                               start_row, start_col, end_row, end_col,
-                               ede_level_walkable_get, 0, EINA_FALSE);
+      if (level->pathfinder == PATHFINDER_FLOWFIELD)
+      {
+         // no route to calc, the enemy will follow the shared flow field
+         if (_shared_dirty) _shared_update();
+         _path_set(e, NULL);
+      }
+      else if (level->pathfinder == PATHFINDER_HPA)
+      {
+         // just the hierarchical route, the legs are refined while walking
+         if (_shared_dirty) _shared_update();
+         _path_set(e, NULL);
+         _route_set(e, ede_pathfinder_path_get(level->rows, level->cols,
+                                               start_row, start_col,
+                                               end_row, end_col,
+                                               ede_level_walkable_get,
+                                               PATHFINDER_HPA,
+                                               ede_level_revision_get()));
+      }
+      else
+      {
+         // get the route from the cache (or calc using the A* pathfinder)
+         _path_set(e, ede_pathfinder_path_get(level->rows, level->cols,
+                                              start_row, start_col,
+                                              end_row, end_col,
+                                              ede_level_walkable_get,
+                                              level->pathfinder,
+                                              ede_level_revision_get()));
+      }
       evas_object_layer_set(e->obj, LAYER_WALKER);
       evas_object_layer_set(e->o_gauge1, LAYER_WALKER);
       evas_object_layer_set(e->o_gauge2, LAYER_WALKER);
    }
 
-   // calc the initial position/rotation and show the enemy
-   e->step_func(e, 0.0);
+   // global counter
+   _count_spawned++;
+
+   // head to the first hop and show the enemy
+   if (!_enemy_hop(e))
+      return;
+   _enemy_render(e);
    evas_object_show(e->obj);
    evas_object_show(e->o_gauge1);
    evas_object_show(e->o_gauge2);
-
-   // global counter
-   _count_spawned++;
 }
 
 EAPI void
 ede_enemy_kill(Ede_Enemy *e)
 {
-   //~ D("alives %d  deads %d", eina_list_count(alives), eina_list_count(deads));
+   //~ D("alives %d  deads %d", _alives_count, _pool_count - _alives_count);
    if (e->killed) return;
    else e->killed = EINA_TRUE;
 
    _count_killed++;
 
-   if (e->path)
-   {
-      eina_list_free(e->path);
-      e->path = NULL;
-   }
-   alives = eina_list_remove(alives, e);
-   EINA_LIST_PUSH(deads, e);
+   _path_job_cancel(e);
+   _path_set(e, NULL);
+   _route_set(e, NULL);
+   _occupancy_move(e, -1);
+   // the last alive one take its place, it become the first dead one
+   _pool_swap(e->index, --_alives_count);
    evas_object_hide(e->obj);
    evas_object_hide(e->o_gauge1);
    evas_object_hide(e->o_gauge2);
@@ -399,18 +1286,27 @@ EAPI void
 ede_enemy_reset(void)
 {
    Ede_Enemy *e;
+   int i;
 
-   while (alives)
+   for (i = 0; i < _alives_count; i++)
    {
-      e = EINA_LIST_POP(alives);
+      e = _pool[i];
       e->killed = EINA_TRUE;
+      e->cell = -1;
+      _path_job_cancel(e);
+      _path_set(e, NULL);
+      _route_set(e, NULL);
       evas_object_hide(e->obj);
       evas_object_hide(e->o_gauge1);
       evas_object_hide(e->o_gauge2);
-
-      EINA_LIST_PUSH(deads, e);
    }
-   _count_spawned = _count_killed = 0;
+   _alives_count = 0;
+   _spatial.count = 0;
+   if (_occupancy.count)
+      memset(_occupancy.count, 0,
+             _occupancy.rows * _occupancy.cols * sizeof(unsigned short));
+   _count_spawned = _count_killed = _count_shared = 0;
+   _shared_dirty = EINA_TRUE;
 }
 
 EAPI void
@@ -426,70 +1322,262 @@ ede_enemy_hit(Ede_Enemy *e, int damage)
    }
 }
 
+/**
+ * Get a reference to the enemy that can be kept across the frames, resolve
+ * it every time with ede_enemy_handle_resolve().
+ */
+EAPI Ede_Enemy_Handle
+ede_enemy_handle_get(Ede_Enemy *e)
+{
+   Ede_Enemy_Handle handle;
+
+   handle.slot = e->slot;
+   handle.born_count = e->born_count;
+   return handle;
+}
+
+/**
+ * Get the enemy referenced by the handle.
+ * @return NULL if the enemy is dead (or dead and born again)
+ */
+EAPI Ede_Enemy *
+ede_enemy_handle_resolve(Ede_Enemy_Handle handle)
+{
+   Ede_Enemy *e;
+
+   if (handle.slot < 0 || handle.slot >= _pool_count)
+      return NULL;
+   e = &_blocks[handle.slot >> ENEMY_BLOCK_SHIFT][handle.slot & (ENEMY_BLOCK - 1)];
+   if (e->killed || e->born_count != handle.born_count)
+      return NULL;
+   return e;
+}
+
+/**
+ * Check if some enemy is in the given rect of cells (ex: the place for a
+ * new tower). Just a look in the occupancy table, kept updated every step.
+ */
+EAPI Eina_Bool
+ede_enemy_area_occupied_get(int row, int col, int rows, int cols)
+{
+   int r, c;
+
+   if (!_occupancy.count)
+      return EINA_FALSE;
+
+   if (row < 0) { rows += row; row = 0; }
+   if (col < 0) { cols += col; col = 0; }
+   for (r = row; r < row + rows && r < _occupancy.rows; r++)
+      for (c = col; c < col + cols && c < _occupancy.cols; c++)
+         if (_occupancy.count[r * _occupancy.cols + c])
+            return EINA_TRUE;
+   return EINA_FALSE;
+}
+
+/**
+ * Get the enemy nearest to the given point (of the last step).
+ * @return NULL if there are no enemies, and distance is set to 999999
+ */
 EAPI Ede_Enemy *
 ede_enemy_nearest_get(int x, int y, int *angle, int *distance)
 {
-   Ede_Enemy *e, *nearest = NULL;
-   Eina_List *l;
-   int min_d = 999999;
+   return _nearest_get(x, y, INFINITY, angle, distance);
+}
 
-   //~ D("NEAREST OF %d %d", x, y);
-   EINA_LIST_FOREACH(alives, l, e)
-   {
-      int dx, dy, d;
+/**
+ * Get the enemy nearest to the given point, only if closer than radius.
+ * Cheaper than ede_enemy_nearest_get(), just the cells in range are visited.
+ */
+EAPI Ede_Enemy *
+ede_enemy_nearest_in_radius_get(int x, int y, int radius,
+                                int *angle, int *distance)
+{
+   return _nearest_get(x, y, (float)radius * radius, angle, distance);
+}
 
-      //~ if (e->id != 1) continue; //dbg
+/**
+ * Get the k enemies nearest to the given point, nearest first.
+ * @param enemies Where to put the enemies, at least k long
+ * @param distances Where to put their distances, at least k long (or NULL)
+ * @return the number of enemies found
+ */
+EAPI int
+ede_enemy_k_nearest_get(int x, int y, int k,
+                        Ede_Enemy **enemies, int *distances)
+{
+   Spatial *g = &_spatial;
+   void *tmp;
+   int i, count;
 
-      // calc distance
-      dx = x - e->x;
-      dy = y - e->y;
-      d = sqrt(dx*dx + dy*dy); // SLOWWWWW TODO simplify
-      if (d < min_d)
+   if (k < 1) return 0;
+   if (k > g->d2_size)
+   {
+      tmp = realloc(g->d2, k * sizeof(float));
+      if (!tmp)
       {
-         min_d = d;
-         nearest = e;
+         CRITICAL("Failure to allocate mem for the proximity grid");
+         return 0;
       }
-      //~ D("  buddy: %.2f %.2f [dx %d dy %d] %d", e->x, e->y, dx, dy, d);
-   }
-   //~ if (nearest)
-      //~ D("NEAREST: id %d, distance: %d", nearest->id, min_d);
-
-   if (angle && nearest)
-   {
-      *angle = ede_util_angle_calc(x, y, nearest->x, nearest->y);
+      g->d2 = tmp;
+      g->d2_size = k;
    }
-   if (distance)
-      *distance = min_d;
+   count = _spatial_nearest(x, y, INFINITY, k, enemies, g->d2);
+   if (distances)
+      for (i = 0; i < count; i++)
+         distances[i] = sqrtf(g->d2[i]);
+   return count;
+}
 
-   return nearest;
+/**
+ * Get the enemies closer than radius to the given point (in no order).
+ * @param enemies Where to put the enemies, max long
+ * @return the number of enemies found, no more than max
+ */
+EAPI int
+ede_enemy_in_radius_get(int x, int y, int radius, Ede_Enemy **enemies, int max)
+{
+   Spatial *g = &_spatial;
+   float dx, dy, radius2 = (float)radius * radius;
+   int row, col, row1, col1, row2, col2, i, c, count = 0;
+
+   if (g->count == 0 || radius <= 0)
+      return 0;
+
+   // the rect of the cells that touch the circle
+   col1 = (x - radius - g->x0) >> SPATIAL_CELL_SHIFT;
+   col2 = (x + radius - g->x0) >> SPATIAL_CELL_SHIFT;
+   row1 = (y - radius - g->y0) >> SPATIAL_CELL_SHIFT;
+   row2 = (y + radius - g->y0) >> SPATIAL_CELL_SHIFT;
+   if (col1 < 0) col1 = 0;
+   if (row1 < 0) row1 = 0;
+   if (col2 >= g->cols) col2 = g->cols - 1;
+   if (row2 >= g->rows) row2 = g->rows - 1;
+
+   for (row = row1; row <= row2; row++)
+      for (col = col1; col <= col2; col++)
+      {
+         c = row * g->cols + col;
+         for (i = g->start[c]; i < g->start[c + 1]; i++)
+         {
+            if (g->items[i]->killed) continue;
+            dx = g->x[i] - x;
+            dy = g->y[i] - y;
+            if (dx * dx + dy * dy >= radius2) continue;
+            if (count == max) return count;
+            enemies[count++] = g->items[i];
+         }
+      }
+   return count;
 }
 
 EAPI int
 ede_enemy_one_step_all(double time)
 {
    Ede_Enemy *e;
-   Eina_List *l, *ll;
+   int i = 0;
 
-   // calc every alive enemy
-   EINA_LIST_FOREACH_SAFE(alives, l, ll, e)
+   // move all the alive enemies at once
+   _movement_run(_alives_count, time);
+
+   // then the ones on their hop head to the next one, and all are redrawn
+   while (i < _alives_count)
    {
-      e->step_func(e, time);
-      _gauge_recalc(e);
+      e = _pool[i];
+      e->x = _mv.x[i];
+      e->y = _mv.y[i];
+      _occupancy_move(e, _occupancy_cell_get(e->x, e->y));
+      if (_mv.reached[i] && !_enemy_hop(e))
+         continue; // home reached, the last alive one is in its place now
+      _enemy_render(e);
+      i++;
    }
 
-   return eina_list_count(alives);
+   // the towers look for the enemies where they are now
+   _spatial_rebuild();
+
+   return _alives_count;
 }
 
 EAPI void
 ede_enemy_path_recalc_all(void)
 {
-   Eina_List *l;
-   Ede_Enemy *e;
+   int i;
 
-   //TODO maybe just mark the path as invalidd and recald on next loop ??
    D(" ");
-   EINA_LIST_FOREACH(alives, l, e)
-      _path_recalc(e);
+
+   // all the walking enemies share the same field, just rebuild it once
+   if (ede_level_current_get()->pathfinder == PATHFINDER_FLOWFIELD)
+   {
+      _shared_update();
+      return;
+   }
+   if (ede_level_current_get()->pathfinder == PATHFINDER_HPA)
+      _shared_update();
+
+   // NOTE: the newest enemies are (mostly) the last in the pool, usually the
+   // ones with the longest way to go: their paths are found first, and the
+   // enemies ahead on the same path take it without searching
+   for (i = _alives_count - 1; i >= 0; i--)
+      _path_recalc(_pool[i]);
+}
+
+/**
+ * Update the enemies routes after the walkability of only the cells in the
+ * given rect has changed (ex: a tower has been placed or sold).
+ */
+EAPI void
+ede_enemy_path_recalc_area(int row, int col, int rows, int cols)
+{
+   Ede_Enemy *e;
+   int i;
+
+   D("%d %d [%dx%d]", row, col, rows, cols);
+
+   // the enemies about to step into the cells must not go on
+   for (i = 0; i < _alives_count; i++)
+      _path_hop_check(_pool[i]);
+
+   // the heuristic tables first, the routes below are calculated with them
+   ede_pathfinder_landmarks_repair(row, col, rows, cols);
+
+   // the routes for the next spawned enemies, ready before they are needed
+   ede_level_routes_update(EINA_FALSE);
+
+   // just repair the part of the field affected by the change
+   if (ede_level_current_get()->pathfinder == PATHFINDER_FLOWFIELD)
+   {
+      if (_shared_dirty || !ede_pathfinder_flowfield_repair(row, col, rows, cols))
+         _shared_update();
+      return;
+   }
+
+   // just rebuild the touched clusters, then the routes (they are cheap)
+   if (ede_level_current_get()->pathfinder == PATHFINDER_HPA)
+   {
+      if (_shared_dirty || !ede_pathfinder_hpa_repair(row, col, rows, cols))
+         _shared_update();
+      for (i = 0; i < _alives_count; i++)
+         _path_recalc(_pool[i]);
+      return;
+   }
+
+   // if the cells has been freed every route can become shorter
+   if (ede_level_walkable_get(row, col))
+   {
+      ede_enemy_path_recalc_all();
+      return;
+   }
+
+   // otherwise the cells has been blocked: a route that do not pass near
+   // the cells is still the best one, only recalc the touched ones (and
+   // the ones still waiting a path calculated on the old grid)
+   for (i = _alives_count - 1; i >= 0; i--)
+   {
+      e = _pool[i];
+      if (e->job || _path_stuck(e) ||
+          _path_touch_area(e, row, col, rows, cols))
+         _path_recalc(e);
+   }
 }
 
 EAPI void
@@ -497,10 +1585,14 @@ ede_enemy_debug_info_fill(Eina_Strbuf *t)
 {
    eina_strbuf_append(t, "<h3>enemies:</h3><br>");
    eina_strbuf_append_printf(t, "on %.3d  off %.3d [max: %d]<br>",
-                             eina_list_count(alives), eina_list_count(deads),
-                             eina_list_count(alives) + eina_list_count(deads));
+                             _alives_count, _pool_count - _alives_count,
+                             _pool_count);
    eina_strbuf_append_printf(t, "spawned %d  killed %d<br>",
                              _count_spawned, _count_killed);
+   eina_strbuf_append_printf(t, "paths shared %d<br>", _count_shared);
+   eina_strbuf_append_printf(t, "movement kernel %s<br>", MOVEMENT_KERNEL);
+   eina_strbuf_append_printf(t, "proximity grid %dx%d<br>",
+                             _spatial.cols, _spatial.rows);
    eina_strbuf_append(t, "<br>");
 }
 
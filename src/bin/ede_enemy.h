@@ -22,13 +22,14 @@
 #define EDE_ENEMY_H
 
 #include <Evas.h>
+#include "ede_astar.h"
 
 typedef struct _Ede_Enemy Ede_Enemy;
 struct _Ede_Enemy
 {
    Evas_Object *obj;
    Evas_Object *o_gauge1, *o_gauge2;
-   float x, y; // current position, in pixel (include accumulation)
+   float x, y; // current position, in pixel (copy of the movement state)
    int w, h;   // size in pixel
    int angle; // current orientation
    int speed; // speed
@@ -37,12 +38,27 @@ struct _Ede_Enemy
    int bucks; // bucks gain if killed
    int target_row, target_col; // target position
    int born_count; // incremented on each born, can be used to check if the enemy has changed
+   int slot;  // fixed place in the pool, see Ede_Enemy_Handle
+   int index; // current place in the pool array (alives first, then deads)
+   int cell;  // the level cell the enemy is in (row * cols + col), -1 if none
 
-   Eina_List *path; // the path to follow as returned by the pathfinder
-   int dest_x, dest_y; // this is the pos of the next hop (the one we are approaching)
+   Ede_Path *path;  // the path to follow (shared with other enemies, read only)
+   const int *hop;  // cursor: the next hop to follow, inside path->hops
+   Ede_Path *route; // HPA* only: the entrance cells to pass through (shared)
+   const int *waypoint; // cursor: the next leg to refine, inside route->hops
+   Ede_Path_Job *job;   // the new path requested, while walking the old one
+   Ede_Enemy *wait_prev, *wait_next; // in the list of the ones with a job
 
    Eina_Bool killed;
-   void (*step_func)(Ede_Enemy *e, double time); // function called every frame to update the enemy
+   Eina_Bool (*hop_func)(Ede_Enemy *e); // called when the hop is reached, to head to the next one
+};
+
+/* a weak reference to an enemy, not valid anymore once the enemy is dead */
+typedef struct _Ede_Enemy_Handle Ede_Enemy_Handle;
+struct _Ede_Enemy_Handle
+{
+   int slot;       // the enemy slot in the pool, -1 for no enemy
+   int born_count; // the version of the enemy in the slot
 };
 
 
@@ -56,7 +72,14 @@ EAPI void ede_enemy_reset(void);
 EAPI void ede_enemy_hit(Ede_Enemy *e, int damage);
 EAPI int  ede_enemy_one_step_all(double time);
 EAPI void ede_enemy_path_recalc_all(void);
+EAPI void ede_enemy_path_recalc_area(int row, int col, int rows, int cols);
+EAPI Ede_Enemy_Handle ede_enemy_handle_get(Ede_Enemy *e);
+EAPI Ede_Enemy *ede_enemy_handle_resolve(Ede_Enemy_Handle handle);
+EAPI Eina_Bool ede_enemy_area_occupied_get(int row, int col, int rows, int cols);
 EAPI Ede_Enemy *ede_enemy_nearest_get(int x, int y, int *angle, int *distance);
+EAPI Ede_Enemy *ede_enemy_nearest_in_radius_get(int x, int y, int radius, int *angle, int *distance);
+EAPI int  ede_enemy_k_nearest_get(int x, int y, int k, Ede_Enemy **enemies, int *distances);
+EAPI int  ede_enemy_in_radius_get(int x, int y, int radius, Ede_Enemy **enemies, int max);
 EAPI void ede_enemy_debug_info_fill(Eina_Strbuf *t);
 
 #endif /* EDE_ENEMY_H */
@@ -174,6 +174,8 @@ _game_loop(void *data)
 
       // spawn wave/enemy as required
       remaining_waves = ede_wave_step(elapsed);
+      // give some time to the pending path requests
+      ede_pathfinder_jobs_run();
       // recalc every enemys
       num_enemies = ede_enemy_one_step_all(elapsed);
       // recalc every towers
@@ -318,6 +320,7 @@ ede_game_reset(void)
    ede_enemy_reset();
    ede_tower_reset();
    ede_bullet_reset();
+   ede_pathfinder_stats_reset();
    ede_level_load_data(ede_level_current_get());
    ede_gui_level_clear();
    ede_gui_tower_button_box_clear();
@@ -351,6 +354,40 @@ ede_game_debug_panel_enable(Eina_Bool enable)
    _debug_panel_enable = enable;
 }
 
+static void
+_debug_pathfinder_stats_fill(Eina_Strbuf *t)
+{
+   Ede_Pathfinder_Stats st;
+   int q, b;
+
+   ede_pathfinder_stats_get(&st);
+   eina_strbuf_append(t, "<h3>pathfinder stats:</h3><br>");
+   eina_strbuf_append_printf(t, "cache hits %d  misses %d<br>",
+                             st.cache_hits, st.cache_misses);
+   eina_strbuf_append_printf(t, "open list peak %d<br>", st.open_peak);
+
+   // calls, cells expanded and latency histogram (<16us, x4 every bucket)
+   for (q = 0; q < PATHFINDER_QUERY_COUNT; q++)
+   {
+      if (!st.calls[q]) continue;
+      eina_strbuf_append_printf(t, "%s: %d calls, %llu expanded  [",
+                                ede_pathfinder_query_name_get(q),
+                                st.calls[q], st.expanded[q]);
+      for (b = 0; b < EDE_PATHFINDER_LATENCY_BUCKETS; b++)
+         eina_strbuf_append_printf(t, b ? " %d" : "%d", st.latency[q][b]);
+      eina_strbuf_append(t, "]<br>");
+   }
+
+   // cells expanded by the one-shot searches, to compare the modes
+   for (q = 0; q < PATHFINDER_MODE_COUNT; q++)
+      if (st.searches[q])
+         eina_strbuf_append_printf(t, "%s: %d searches, %llu avg expanded<br>",
+                                   ede_pathfinder_mode_name_get(q),
+                                   st.searches[q],
+                                   st.mode_expanded[q] / st.searches[q]);
+   eina_strbuf_append(t, "<br>");
+}
+
 EAPI void
 ede_game_debug_panel_update(double now)
 {
@@ -387,6 +424,8 @@ ede_game_debug_panel_update(double now)
 
    // info from other components
    ede_enemy_debug_info_fill(t);
+   ede_pathfinder_debug_info_fill(t);
+   _debug_pathfinder_stats_fill(t);
    ede_tower_debug_info_fill(t);
    ede_bullet_debug_info_fill(t);
    ede_level_debug_info_fill(t);
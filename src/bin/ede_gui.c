@@ -78,6 +78,7 @@ static Evas_Object *o_circle; /** Polygon obj used for the selection range */
 static int area_req_rows, area_req_cols; /** size of the current area request */
 static void (*area_req_done_cb)(int row, int col, int w, int h, void *data); /** function to call on area selection complete */
 static void *area_req_done_data; /** user data to pass-back in the area_req_done_cb */
+static int area_test_row, area_test_col; /** position of the area under test, see _area_request_walkable_get() */
 static Eina_Bool selection_ok;   /** true if the selection is in a free position */
 
 
@@ -1008,6 +1009,8 @@ ede_gui_selection_hide(void)
 static void
 _area_request_mouse_move(int x, int y)
 {
+   Ede_Level *level = ede_level_current_get();
+   Eina_Bool blocking = EINA_FALSE;
    int row, col, i, j;
 
    // hide the selection when mouse is out the checkboard
@@ -1026,36 +1029,51 @@ _area_request_mouse_move(int x, int y)
             selection_ok = EINA_FALSE;
 
    // now check if an enemy is under the requested area
-   if (selection_ok)
+   if (selection_ok &&
+       ede_enemy_area_occupied_get(row, col, area_req_rows, area_req_cols))
+      selection_ok = EINA_FALSE;
+
+   // and if it would cut the way home to some enemy (this is not a search,
+   // the answer is calculated once every time the grid change)
+   if (selection_ok &&
+       ede_pathfinder_placement_blocking_get(level->rows, level->cols,
+                                             level->home_row, level->home_col,
+                                             level->starts, 10, row, col,
+                                             area_req_rows, area_req_cols,
+                                             ede_level_walkable_get,
+                                             ede_level_revision_get()))
    {
-      Evas_Object *under;
-      int sx, sy, w, h;
-
-      ede_gui_cell_coords_get(row, col, &sx, &sy, EINA_FALSE);
-      w = area_req_cols * CELL_W;
-      h = area_req_rows * CELL_H;
-      under = evas_object_top_in_rectangle_get(ede_gui_canvas_get(),
-                                               sx,  sy,  w,  h,
-                                               EINA_FALSE, EINA_FALSE);
-      if (under != o_checkboard)
-         selection_ok = EINA_FALSE;
+      blocking = EINA_TRUE;
+      selection_ok = EINA_FALSE;
    }
 
    // make the selection green or red
-   ede_gui_selection_type_set(selection_ok ? SELECTION_FREE : SELECTION_WRONG);
+   ede_gui_selection_type_set(blocking ? SELECTION_BLOCKING :
+                              selection_ok ? SELECTION_FREE : SELECTION_WRONG);
 
    // move the selection at the right place
    ede_gui_selection_show_at(row, col, area_req_rows, area_req_cols, 0);
 }
 
+/**
+ * As ede_level_walkable_get() but the cells of the area under test are
+ * considered already taken.
+ */
+static Eina_Bool
+_area_request_walkable_get(int row, int col)
+{
+   if (row >= area_test_row && row < area_test_row + area_req_rows &&
+       col >= area_test_col && col < area_test_col + area_req_cols)
+      return EINA_FALSE;
+   return ede_level_walkable_get(row, col);
+}
+
 static void
 _area_request_mouse_down(int x, int y,
                          Eina_Bool inside_checkboard, Eina_Bool on_a_tower)
 {
    Ede_Level *level = ede_level_current_get();
-   Eina_List *l;
    int mouse_row, mouse_col;
-   int row, col, i, j;
 
    D(" ");
 
@@ -1085,41 +1103,17 @@ _area_request_mouse_down(int x, int y,
 
    /*
     * ok, all the needed cells are free, now check if we are blocking some
-    * possible path. Pathfind from all the starting bases to the home.
+    * possible path. A single flood from the home, with the needed cells
+    * considered as taken, must reach all the starting bases (0..9).
     */
-
-
-   // set all the needed cells to a temporary (unwalkable) value
-   for (i = 0; i < area_req_cols; i++)
-      for (j = 0; j < area_req_rows; j++)
-         cells[mouse_row + j][mouse_col + i] += 100;
-
-   for (i = 0; i < 10; i++) // Base 0..9
-   {
-      for (l = level->starts[i]; l; l = l->next->next) // all the points for the Base
-      {
-         row = (int)l->data;
-         col = (int)l->next->data;
-
-         // run the pathfinder in 'just_check' mode
-         //~ D("Check Start Base%d: %d %d", i, row, col);
-         selection_ok = (int)ede_pathfinder(level->rows, level->cols, row, col,
-                                            level->home_row, level->home_col,
-                                            ede_level_walkable_get, 0, EINA_TRUE);
-         if (!selection_ok)
-         {
-            D("WRONG !!!!");
-            goto end_loop;
-         }
-      }
-   }
-
-end_loop:
-
-   // restore all the needed cells values to the original state
-   for (i = 0; i < area_req_cols; i++)
-      for (j = 0; j < area_req_rows; j++)
-         cells[mouse_row + j][mouse_col + i] -= 100;
+   area_test_row = mouse_row;
+   area_test_col = mouse_col;
+   selection_ok = ede_pathfinder_reachable_check(level->rows, level->cols,
+                                                 level->home_row, level->home_col,
+                                                 level->starts, 10,
+                                                 _area_request_walkable_get);
+   if (!selection_ok)
+      D("WRONG !!!!");
 
    if (selection_ok)
    {
@@ -45,7 +45,9 @@
 /* Local subsystem vars */
 static Eina_List *scenarios = NULL;       // Ede_Scenario*
 static Ede_Level *current_level = NULL;
+static unsigned int revision = 0; // bumped on every change of the cells
 Ede_Level_Cell **cells = NULL;
+static Ede_Walkable_Map *walkable_map = NULL; // bitmap of the cells, for the pathfinder
 Eina_List *waves = NULL;
 
 /* Local subsystem callbacks */
@@ -118,6 +120,15 @@ _load_level_header(const char *name)
          {}
       else if (sscanf(buf, "Bucks=%d", &level->bucks) == 1)
          {}
+      else if (sscanf(buf, "Pathfinder=%[^\n]", str) == 1)
+      {
+         if (!ede_pathfinder_mode_get_by_name(str, &level->pathfinder))
+            WRN("Unknown pathfinder '%s', using astar", str);
+      }
+      else if (sscanf(buf, "Landmarks=%d", &level->landmarks) == 1)
+         {}
+      else if (sscanf(buf, "SmoothPaths=%d", &level->smooth_paths) == 1)
+         {}
       else if (strncmp(buf, "DATA", 4) == 0)
          level->data_start_at_line = count;
    }
@@ -280,8 +291,8 @@ ede_level_shutdown(void)
       _wave_free(wave);
 
    ede_array_free((int **)cells);
-
-
+   ede_pathfinder_walkable_map_free(walkable_map);
+   walkable_map = NULL;
 
    EINA_LIST_FREE(scenarios, sce)
       _scenario_free(sce);
@@ -312,6 +323,11 @@ ede_level_load_data(Ede_Level *level)
    // free/alloc the 2D array for the cell data
    if (cells) ede_array_free((int **)cells);
    cells = (Ede_Level_Cell**)ede_array_new(level->rows, level->cols);
+   revision++;
+
+   // and the walkability bitmap, filled when the data is parsed
+   ede_pathfinder_walkable_map_free(walkable_map);
+   walkable_map = NULL;
 
    // read the DATA part
    row = col = 0;
@@ -387,7 +403,25 @@ ede_level_load_data(Ede_Level *level)
       return EINA_FALSE;
    }
 
+   // build the walkability bitmap, kept in sync by ede_level_cell_set()
+   walkable_map = ede_pathfinder_walkable_map_new(level->rows, level->cols);
+   if (walkable_map)
+      for (row = 0; row < level->rows; row++)
+         for (col = 0; col < level->cols; col++)
+            ede_pathfinder_walkable_map_set(walkable_map, row, col,
+                                            cells[row][col] <= CELL_EMPTY);
+   ede_pathfinder_walkable_map_use(walkable_map, ede_level_walkable_get);
+
    current_level = level;
+
+   // the landmarks tables, kept in sync by ede_enemy_path_recalc_area()
+   ede_pathfinder_landmarks_build(level->rows, level->cols, level->landmarks,
+                                  ede_level_walkable_get);
+   ede_pathfinder_smoothing_set(level->smooth_paths);
+
+   // the routes of the spawned enemies, before the first wave
+   ede_level_routes_update(EINA_TRUE);
+
    ede_level_dump(level); // DBG
    return EINA_TRUE;
 }
@@ -420,6 +454,47 @@ ede_level_walkable_get(int row, int col)
    return cells[row][col] <= CELL_EMPTY;
 }
 
+/**
+ * Change the type of the given cell (in the current level).
+ * Always use this (not the cells array) so that the grid revision is updated.
+ */
+EAPI void
+ede_level_cell_set(int row, int col, Ede_Level_Cell type)
+{
+   if (cells[row][col] == type)
+      return;
+   cells[row][col] = type;
+   revision++;
+   if (walkable_map)
+      ede_pathfinder_walkable_map_set(walkable_map, row, col,
+                                      type <= CELL_EMPTY);
+}
+
+/**
+ * Get the grid revision: a counter bumped every time a cell change.
+ * Can be used to check if something calculated on the grid is still valid.
+ */
+EAPI unsigned int
+ede_level_revision_get(void)
+{
+   return revision;
+}
+
+/**
+ * Calculate the routes from all the start bases to home on the current grid,
+ * so the enemies spawned find them ready. Call after every grid change.
+ * @param wait calculate them now (at load time), otherwise in the next frames
+ */
+EAPI void
+ede_level_routes_update(Eina_Bool wait)
+{
+   ede_pathfinder_routes_update(current_level->rows, current_level->cols,
+                                current_level->home_row, current_level->home_col,
+                                current_level->starts, 10,
+                                ede_level_walkable_get,
+                                current_level->pathfinder, revision, wait);
+}
+
 /**
  * Dump a level to stdout (for debugging purpose)
  */
@@ -440,6 +515,9 @@ ede_level_dump(Ede_Level *level)
    printf(" Version: '%d'\n", level->version);
    printf(" Size: '%dx%d'\n", level->cols, level->rows);
    printf(" Towers: '%s'\n", level->towers);
+   printf(" Pathfinder: '%s'\n", ede_pathfinder_mode_name_get(level->pathfinder));
+   printf(" Landmarks: '%d'\n", level->landmarks);
+   printf(" SmoothPaths: '%d'\n", level->smooth_paths);
 
    if (cells)
    {
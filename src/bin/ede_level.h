@@ -21,6 +21,7 @@
 #ifndef EDE_LEVEL_H
 #define EDE_LEVEL_H
 
+#include "ede_astar.h"
 
 typedef enum {
    CELL_UNKNOW,
@@ -64,6 +65,9 @@ struct _Ede_Level
    int bucks;
    int data_start_at_line;
    int home_row, home_col;
+   Ede_Pathfinder_Mode pathfinder; // how the walking enemies find their way home
+   int landmarks; // landmark cells for the A* heuristic (0 for none)
+   int smooth_paths; // walk straight where possible (not only in 8 directions)
 
    Eina_List *starts[10]; // 10 lists of enemy starting points (row, col, row, col, etc..)
 };
@@ -93,6 +97,9 @@ EAPI Eina_Bool  ede_level_load_data(Ede_Level *level);
 EAPI Ede_Level *ede_level_current_get(void);
 EAPI Ede_Level *ede_level_next_get(void);
 EAPI Eina_Bool  ede_level_walkable_get(int row, int col);
+EAPI void       ede_level_cell_set(int row, int col, Ede_Level_Cell type);
+EAPI unsigned int ede_level_revision_get(void);
+EAPI void       ede_level_routes_update(Eina_Bool wait);
 EAPI void       ede_level_free(Ede_Level *level);
 EAPI void       ede_level_dump(Ede_Level *level);
 EAPI Eina_List *ede_level_scenario_list_get(void);
@@ -148,10 +148,10 @@ _tower_add_real(int row, int col, int rows, int cols, void *data)
    // mark all the tower cells as unwalkable
    for (i = col; i < col + cols; i++)
       for (j = row; j < row + rows; j++)
-         cells[j][i] = CELL_TOWER;
+         ede_level_cell_set(j, i, CELL_TOWER);
 
    // tell the enemies that the grid has changed
-   ede_enemy_path_recalc_all();
+   ede_enemy_path_recalc_area(row, col, rows, cols);
 
    // add to the towers list
    alive_towers = eina_list_append(alive_towers, tower);
@@ -168,10 +168,10 @@ _tower_del(Ede_Tower *tower)
    // mark all the tower cells as empty
    for (i = tower->col; i < tower->col + tower->cols; i++)
       for (j = tower->row; j < tower->row + tower->rows; j++)
-         cells[j][i] = CELL_EMPTY;
+         ede_level_cell_set(j, i, CELL_EMPTY);
 
    // tell the enemies that the grid has changed
-   ede_enemy_path_recalc_all();
+   ede_enemy_path_recalc_area(tower->row, tower->col, tower->rows, tower->cols);
 
    // hide the selection
    ede_gui_selection_hide();
@@ -206,7 +206,6 @@ _tower_step(Ede_Tower *tower, double time)
    Ede_Enemy *e;
    int angle = 0;
    double fangle = 0.0;
-   int distance = 0;
 
    // check reload time
    tower->reload_counter -= time;
@@ -214,9 +213,9 @@ _tower_step(Ede_Tower *tower, double time)
       return;
 
    // fire to the closest enemy (if in range)
-   // TODO no need to get the nearest every reload, every 1 or 2 seconds is enoughts
-   e = ede_enemy_nearest_get(tower->center_x, tower->center_y, &angle, &distance);
-   if (distance < tower->range)
+   e = ede_enemy_nearest_in_radius_get(tower->center_x, tower->center_y,
+                                       tower->range, &angle, NULL);
+   if (e)
    {
       fangle = angle;
       edje_object_message_send(tower->obj, EDJE_MESSAGE_FLOAT, 123, &fangle);